@@ -0,0 +1,157 @@
+//
+// Copyright(C) 2023 David St-Louis
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+//
+// *Command line tool: loads games and generates their APWorlds, without a window*
+//
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <filesystem>
+
+#include "data.h"
+#include "data_load.h"
+#include "daemon.h"
+#include "generate.h"
+
+#include "message.hpp"
+#include "util.hpp"
+
+
+static void print_usage(void)
+{
+    printf(
+        "Usage: ap_gen_cli [options] [<game.json or folder>...]\n"
+        "Generates the APWorld of every game given, or of every game in ./games if none are.\n"
+        "\n"
+        "  --output <folder>        Where .apworld files go (default: ./output)\n"
+        "  --world-folder <folder>  Write into an Archipelago worlds folder instead\n"
+        "  --default-json <folder>  Use these default json tables instead of the built-in ones\n"
+        "  --daemon <socket>        Keep the games loaded and generate on request, see daemon.h\n"
+    );
+}
+
+
+int main(int argc, char** argv)
+{
+    long runtime_start = get_runtime_us();
+
+    // Read wherever they're needed, same as in the editor
+    core_arguments.assign(argv + 1, argv + argc);
+    OnScreenMessages::UseConsole();
+
+    std::vector<std::string> game_files;
+    std::string socket_path;
+    for (int i = 0; i < (int)core_arguments.size(); ++i)
+    {
+        const std::string& arg = core_arguments[i];
+        if (arg == "--output" || arg == "--world-folder" || arg == "--default-json" || arg == "--daemon")
+        {
+            if (i + 1 >= (int)core_arguments.size())
+            {
+                fprintf(stderr, "error: %s requires an argument.\n", arg.c_str());
+                return 2;
+            }
+            if (arg == "--daemon")
+                socket_path = core_arguments[i + 1];
+            ++i;
+        }
+        else if (arg == "--help" || arg == "-h")
+        {
+            print_usage();
+            return 0;
+        }
+        else if (arg.compare(0, 2, "--") == 0)
+        {
+            fprintf(stderr, "error: Unknown option '%s'.\n", arg.c_str());
+            print_usage();
+            return 2;
+        }
+        else if (std::filesystem::is_directory(arg))
+        {
+            auto found = find_game_jsons(arg);
+            game_files.insert(game_files.end(), found.begin(), found.end());
+        }
+        else
+            game_files.push_back(arg);
+    }
+    if (game_files.empty())
+        game_files = find_game_jsons("./games");
+    if (game_files.empty())
+    {
+        fprintf(stderr, "error: No games to generate.\n");
+        return 1;
+    }
+
+    init_data();
+
+    // Every game loads on its own thread, like in the editor. Nothing only the editor draws is loaded.
+    std::vector<game_t> loaded(game_files.size());
+    std::vector<std::vector<std::string>> load_errors(game_files.size());
+    std::vector<char> succeeded(game_files.size(), 0);
+    {
+        std::vector<std::thread> load_threads;
+        for (size_t i = 0; i < game_files.size(); ++i)
+        {
+            load_threads.emplace_back([&, i]()
+            {
+                succeeded[i] = init_game(game_files[i], loaded[i], load_errors[i], nullptr, true);
+            });
+        }
+        for (auto& thread : load_threads)
+            thread.join();
+    }
+
+    int failed = 0;
+    std::vector<game_t*> to_generate;
+    for (size_t i = 0; i < game_files.size(); ++i)
+    {
+        for (const auto& error : load_errors[i])
+            OnScreenMessages::AddError(error);
+        if (!succeeded[i])
+        {
+            ++failed;
+            continue;
+        }
+        if (games.count(loaded[i].short_name))
+        {
+            OnScreenMessages::AddError("'" + game_files[i] + "' has the same short name as another game, skipping it.");
+            ++failed;
+            continue;
+        }
+
+        auto game = &games[loaded[i].short_name];
+        *game = std::move(loaded[i]);
+        if (!load(game, false))
+        {
+            games.erase(game->short_name);
+            ++failed;
+            continue;
+        }
+        to_generate.push_back(game);
+    }
+
+    int result;
+    if (!socket_path.empty())
+        result = run_daemon(socket_path);
+    else
+    {
+        failed += generate_all(to_generate);
+        log_info("Done: " + std::to_string(game_files.size() - failed) + " of " + std::to_string(game_files.size())
+            + " game(s) generated (" + compare_runtime(runtime_start) + " sec)");
+        result = failed ? 1 : 0;
+    }
+    return result;
+}
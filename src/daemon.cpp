@@ -0,0 +1,411 @@
+#include "daemon.h"
+#include "data.h"
+#include "data_load.h"
+#include "generate.h"
+#include "json_writer.hpp"
+
+#include "message.hpp"
+#include "util.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <sstream>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <afunix.h>
+typedef SOCKET socket_t;
+#define close_socket closesocket
+#define poll WSAPoll
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+#define close_socket close
+#endif
+
+
+// Same as the editor's, without saves or loads in flight: the daemon does one thing at a time
+struct watched_file_t
+{
+    std::string short_name;
+    bool is_data = false; // The .data.json, otherwise the .game.json or a wad
+    std::filesystem::file_time_type time;
+    uintmax_t size = 0;
+};
+
+struct game_stats_t
+{
+    int loads = 0; // The first one included
+    long last_load_us = 0; // Of the last reload
+};
+
+static std::map<std::string, watched_file_t> watched_files; // By path
+static std::map<std::string, game_stats_t> game_stats; // By short name
+static int request_count = 0;
+static int generated_count = 0;
+static int failed_count = 0;
+static long generation_us = 0;
+static volatile sig_atomic_t quit_requested = 0;
+
+
+static void on_quit_signal(int)
+{
+    quit_requested = 1;
+}
+
+
+static void watch_game(const game_t* game)
+{
+    for (auto it = watched_files.begin(); it != watched_files.end();)
+    {
+        if (it->second.short_name == game->short_name)
+            it = watched_files.erase(it);
+        else
+            ++it;
+    }
+
+    auto paths = get_game_files(game);
+    for (int i = 0; i < (int)paths.size(); ++i)
+    {
+        auto& file = watched_files[paths[i]];
+        file.short_name = game->short_name;
+        file.is_data = (i == (int)paths.size() - 1);
+        std::error_code ec;
+        file.time = std::filesystem::last_write_time(paths[i], ec);
+        file.size = ec ? 0 : std::filesystem::file_size(paths[i], ec);
+    }
+}
+
+
+// Loads it again from scratch. There's nothing to carry over, the daemon never edits levels.
+static bool reload_game(game_t* game)
+{
+    long start_time = get_runtime_us();
+    game_t reloaded;
+    std::vector<std::string> errors;
+    bool succeeded = init_game(game->path, reloaded, errors, nullptr, true);
+    for (const auto& error : errors)
+        OnScreenMessages::AddError(error);
+    if (!succeeded)
+    {
+        OnScreenMessages::AddWarning("Keeping the previously loaded '" + game->full_name + "'.");
+        return false;
+    }
+    if (reloaded.short_name != game->short_name)
+    {
+        OnScreenMessages::AddError("'" + game->path + "' changed its short name, restart the daemon to load it.");
+        return false;
+    }
+
+    *game = std::move(reloaded);
+    succeeded = load(game, false);
+    watch_game(game);
+
+    auto& stats = game_stats[game->short_name];
+    stats.loads++;
+    stats.last_load_us = get_runtime_us() - start_time;
+    OnScreenMessages::AddNotice("Reloaded game '" + game->full_name + "' (" + compare_runtime(start_time) + " sec)");
+    return succeeded;
+}
+
+
+// Only the edits changed, the maps stay as they are
+static bool reload_game_data(game_t* game)
+{
+    std::string filename = "data/" + game->short_name + ".data.json";
+    auto json_data = read_file_data(filename);
+    if (hash_bytes(json_data.data(), json_data.size()) == game->data_hash && json_data.size() == game->data_size)
+        return true;
+
+    for (auto& episode : game->episodes)
+    {
+        for (auto& meta : episode)
+        {
+            meta.state = map_state_t();
+            meta.history = map_history_t();
+            meta.save_version = 0;
+        }
+    }
+    bool succeeded = load(game, false);
+    OnScreenMessages::AddNotice("Reloaded '" + filename + "'");
+    return succeeded;
+}
+
+
+// Polled about once a second, and before every generation so it never uses stale files
+static void poll_watched_files()
+{
+    std::set<std::string> changed_games, changed_data;
+    for (auto& kv : watched_files)
+    {
+        auto& file = kv.second;
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time(kv.first, ec);
+        auto size = ec ? 0 : std::filesystem::file_size(kv.first, ec);
+        if (time == file.time && size == file.size)
+            continue;
+        file.time = time;
+        file.size = size;
+        (file.is_data ? changed_data : changed_games).insert(file.short_name);
+    }
+
+    for (const auto& short_name : changed_games)
+    {
+        auto it = games.find(short_name);
+        if (it != games.end())
+            reload_game(&it->second);
+    }
+    for (const auto& short_name : changed_data)
+    {
+        auto it = games.find(short_name);
+        if (it != games.end() && !changed_games.count(short_name))
+            reload_game_data(&it->second);
+    }
+}
+
+
+// The games named, or all of them if none are
+static bool find_games(const std::vector<std::string>& names, std::vector<game_t*>& found)
+{
+    if (names.empty())
+    {
+        for (auto& kv : games)
+            found.push_back(&kv.second);
+        return true;
+    }
+    for (const auto& name : names)
+    {
+        auto it = games.find(name);
+        if (it == games.end())
+        {
+            OnScreenMessages::AddError("No game named '" + name + "' is loaded.");
+            return false;
+        }
+        found.push_back(&it->second);
+    }
+    return true;
+}
+
+
+// Returns the last line of the reply, the messages printed meanwhile go before it
+static std::string handle_request(const std::string& request, bool& quit)
+{
+    std::istringstream words(request);
+    std::string command;
+    std::vector<std::string> args;
+    words >> command;
+    for (std::string arg; words >> arg;)
+        args.push_back(arg);
+
+    if (command == "generate")
+    {
+        poll_watched_files();
+        std::vector<game_t*> to_generate;
+        if (!find_games(args, to_generate))
+            return "error unknown game";
+        long start_time = get_runtime_us();
+        int failed = generate_all(to_generate);
+        generation_us += get_runtime_us() - start_time;
+        generated_count += (int)to_generate.size() - failed;
+        failed_count += failed;
+        std::string summary = std::to_string(to_generate.size() - failed) + " of " + std::to_string(to_generate.size())
+            + " world(s) generated (" + compare_runtime(start_time) + " sec)";
+        return (failed ? "error " : "ok ") + summary;
+    }
+    if (command == "reload")
+    {
+        std::vector<game_t*> to_reload;
+        if (!find_games(args, to_reload))
+            return "error unknown game";
+        int failed = 0;
+        for (auto game : to_reload)
+            if (!reload_game(game))
+                ++failed;
+        std::string summary = std::to_string(to_reload.size() - failed) + " of " + std::to_string(to_reload.size()) + " game(s) reloaded";
+        return (failed ? "error " : "ok ") + summary;
+    }
+    if (command == "stats")
+    {
+        for (const auto& kv : games)
+        {
+            const auto& game = kv.second;
+            const auto& stats = game_stats[kv.first];
+            int level_count = 0;
+            for (const auto& episode : game.episodes)
+                level_count += (int)episode.size();
+            std::string line = kv.first + ": " + std::to_string(level_count) + " level(s), loaded " + std::to_string(stats.loads) + " time(s)";
+            if (stats.loads > 1)
+                line += ", last in " + compare_runtime(0, stats.last_load_us) + " sec";
+            OnScreenMessages::Add(line);
+        }
+        return "ok " + std::to_string(games.size()) + " game(s), " + std::to_string(request_count) + " request(s), "
+            + std::to_string(generated_count) + " world(s) generated, " + std::to_string(failed_count) + " failed, "
+            + compare_runtime(0, generation_us) + " sec generating";
+    }
+    if (command == "quit")
+    {
+        quit = true;
+        return "ok quitting";
+    }
+    return "error unknown command '" + command + "', expected generate, reload, stats or quit";
+}
+
+
+// One line, from a client that gets a few seconds to send it
+static bool read_request(socket_t client, std::string& request)
+{
+    char buffer[1024];
+    while (request.size() < 4096)
+    {
+        pollfd pfd = {};
+        pfd.fd = client;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, 5000) <= 0)
+            return false;
+        int received = (int)recv(client, buffer, sizeof(buffer), 0);
+        if (received <= 0)
+            return !request.empty(); // Closed its end without a new line
+        request.append(buffer, received);
+
+        auto end = request.find('\n');
+        if (end != std::string::npos)
+        {
+            request.resize(end);
+            if (!request.empty() && request.back() == '\r')
+                request.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static void send_all(socket_t client, const std::string& text)
+{
+    size_t sent = 0;
+    while (sent < text.size())
+    {
+        int result = (int)send(client, text.data() + sent, (int)(text.size() - sent), 0);
+        if (result <= 0)
+            return; // The client went away, nothing to do about it
+        sent += result;
+    }
+}
+
+
+int run_daemon(const std::string& socket_path)
+{
+    for (const auto& kv : games)
+    {
+        watch_game(&kv.second);
+        game_stats[kv.first].loads = 1;
+    }
+
+#if defined(WIN32)
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+    {
+        OnScreenMessages::AddError("Failed to initialize sockets.");
+        return 1;
+    }
+#endif
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path))
+    {
+        OnScreenMessages::AddError("Socket path '" + socket_path + "' is too long.");
+        return 1;
+    }
+    memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    // A socket file nothing answers on was left behind by a daemon that didn't quit cleanly
+    socket_t probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe != INVALID_SOCKET)
+    {
+        bool in_use = connect(probe, (sockaddr*)&addr, sizeof(addr)) == 0;
+        close_socket(probe);
+        if (in_use)
+        {
+            OnScreenMessages::AddError("Another daemon is already listening on '" + socket_path + "'.");
+            return 1;
+        }
+    }
+    remove(socket_path.c_str());
+
+    socket_t listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == INVALID_SOCKET ||
+        bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(listener, 8) != 0)
+    {
+        OnScreenMessages::AddError("Can't listen on '" + socket_path + "'.");
+        if (listener != INVALID_SOCKET)
+            close_socket(listener);
+        return 1;
+    }
+
+    signal(SIGINT, on_quit_signal);
+    signal(SIGTERM, on_quit_signal);
+#if !defined(WIN32)
+    signal(SIGPIPE, SIG_IGN); // A client closing early only fails its send()
+#endif
+    log_info("Listening on '" + socket_path + "'");
+
+    bool quit = false;
+    auto last_watch_poll = std::chrono::steady_clock::now();
+    while (!quit && !quit_requested)
+    {
+        pollfd pfd = {};
+        pfd.fd = listener;
+        pfd.events = POLLIN;
+        int ready = poll(&pfd, 1, 1000);
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_watch_poll >= std::chrono::seconds(1))
+        {
+            last_watch_poll = now;
+            poll_watched_files();
+        }
+        if (ready <= 0)
+            continue; // Timed out, or interrupted by a signal
+
+        socket_t client = accept(listener, nullptr, nullptr);
+        if (client == INVALID_SOCKET)
+            continue;
+        std::string request;
+        if (read_request(client, request))
+        {
+            ++request_count;
+            log_info("Request: " + request);
+            std::vector<std::string> reply;
+            OnScreenMessages::Capture(&reply);
+            reply.push_back(handle_request(request, quit));
+            OnScreenMessages::Capture(nullptr);
+
+            std::string text;
+            for (const auto& line : reply)
+                text += line + "\n";
+            send_all(client, text);
+        }
+        close_socket(client);
+    }
+
+    close_socket(listener);
+    remove(socket_path.c_str());
+#if defined(WIN32)
+    WSACleanup();
+#endif
+    log_info("Daemon stopped");
+    return 0;
+}
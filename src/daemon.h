@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+
+// Keeps the loaded games in memory and serves requests on a local (Unix domain) socket.
+// A client connects, sends one line, and reads until the daemon closes the connection.
+// The reply is the messages printed while handling it, then "ok <summary>" or "error <summary>".
+//
+//   generate [<short name>...]   Generates the given games, or all of them
+//   reload [<short name>...]     Reloads the given games from disk, or all of them
+//   stats                        One line per game, then the totals
+//   quit                         Stops the daemon
+//
+// The .game.json, wads and .data.json of every game are watched, and a game is brought up
+// to date before it's generated, so a request never sees stale files.
+int run_daemon(const std::string& socket_path);
@@ -1,16 +1,22 @@
 #include "data.h"
 #include "maps.h"
 
+#include <algorithm>
 #include <chrono>
+#include <climits>
+#include <cmath>
+#include <filesystem>
+#include <memory>
 
-#include <onut/Files.h>
-#include <onut/Json.h>
-#include <onut/Log.h>
 #include <json/json.h>
 
+#include "embedded_json.h"
+#include "json_reader.hpp"
 #include "message.hpp"
+#include "util.hpp"
 
 std::map<std::string, game_t> games;
+std::map<std::string, game_catalog_entry_t> game_catalog;
 
 void parse_item(ap_item_def_t &item, const Json::Value &json)
 {
@@ -63,267 +69,612 @@ void stringarray_to_vector(std::vector<std::string> &entry, const Json::Value &j
     }
 }
 
-// Default game info
-static Json::Value default_game_infos;
-static Json::Value default_world_infos;
-static Json::Value default_items;
-static Json::Value default_locations;
+// Item categories, as merged from the defaults and a game's "items"
+struct item_tables_t
+{
+    std::vector<ap_item_def_t> extra_connection_requirements;
+    std::vector<ap_item_def_t> progression;
+    std::vector<ap_item_def_t> useful;
+    std::vector<ap_item_def_t> filler;
+    std::vector<ap_item_def_t> unique_progression;
+    std::vector<ap_item_def_t> unique_useful;
+    std::vector<ap_item_def_t> unique_filler;
+    std::vector<ap_key_def_t> keys;
+};
+
+// Same for "world_info"
+struct world_info_t
+{
+    bool present = false;
+    std::vector<std::string> description;
+    Json::Value world_options = Json::arrayValue;
+    std::map<std::string, std::vector<std::string>> hooks;
+    std::map<std::string, int> helpful_item_weight;
+    std::map<int, std::vector<int>> item_pool_ratio;
+};
+
+// Defaults per IWAD, parsed once from the tables built into the executable
+static std::map<std::string, Json::Value> default_game_infos;
+static std::map<std::string, world_info_t> default_world_infos;
+static std::map<std::string, item_tables_t> default_items;
+static std::map<std::string, std::map<int, std::string>> default_locations;
+
+// Replaces the categories present in json
+static void parse_item_tables(item_tables_t& tables, const Json::Value& json)
+{
+    if (!json.isObject())
+        return;
+
+    std::pair<const char*, std::vector<ap_item_def_t>*> categories[] = {
+        {"extra_connection_requirements", &tables.extra_connection_requirements},
+        {"progression", &tables.progression},
+        {"useful", &tables.useful},
+        {"filler", &tables.filler},
+        {"unique_progression", &tables.unique_progression},
+        {"unique_useful", &tables.unique_useful},
+        {"unique_filler", &tables.unique_filler},
+    };
+    for (const auto& category : categories)
+    {
+        if (!json.isMember(category.first))
+            continue;
+        category.second->clear();
+        parse_items(*category.second, json[category.first]);
+    }
+
+    if (json.isMember("keys"))
+    {
+        tables.keys.clear();
+        for (const auto& key_json : json["keys"])
+        {
+            ap_key_def_t item;
+            parse_item(item.item, key_json);
+            item.key = key_json["key"].asInt();
+            item.use_skull = key_json["use_skull"].asBool();
+            item.region_name = key_json["region_name"].asString();
+            item.color = color_t(key_json["color"][0].asFloat(), key_json["color"][1].asFloat(), key_json["color"][2].asFloat());
+            tables.keys.push_back(item);
+        }
+    }
+}
+
+// Replaces the fields present in json
+static void parse_world_info(world_info_t& info, const Json::Value& json)
+{
+    if (!json.isObject() || json.empty())
+        return;
+    info.present = true;
+
+    // World description: used as the docstring for the world class
+    if (json.isMember("description"))
+    {
+        info.description.clear();
+        stringarray_to_vector(info.description, json["description"]);
+    }
+
+    // World options: Automatic addition of common hooks and options
+    if (json.isMember("world_options"))
+        info.world_options = json["world_options"].isArray() ? json["world_options"] : Json::Value(Json::arrayValue);
+
+    // World hooks: allows some extra python code in certain places, if necessary
+    if (json.isMember("hooks"))
+    {
+        info.hooks.clear();
+        if (json["hooks"].isObject())
+        {
+            const auto& hook_types = json["hooks"].getMemberNames();
+            for (const auto& hook_type : hook_types)
+                stringarray_to_vector(info.hooks[hook_type], json["hooks"][hook_type]);
+        }
+    }
+
+    // Helpful item weights: Lets worlds have a weighted "helpful" filler pool
+    if (json.isMember("helpful_item_weight"))
+    {
+        info.helpful_item_weight.clear();
+        if (json["helpful_item_weight"].isObject())
+        {
+            const auto& item_names = json["helpful_item_weight"].getMemberNames();
+            for (const auto& item_name : item_names)
+                info.helpful_item_weight.try_emplace(item_name, json["helpful_item_weight"][item_name].asInt());
+        }
+    }
+
+    // Item pool ratio: Size of the helpful and random pools relative to number of locations
+    if (json.isMember("item_pool_ratio"))
+    {
+        info.item_pool_ratio.clear();
+        if (json["item_pool_ratio"].isObject())
+        {
+            const auto& difficulties = json["item_pool_ratio"].getMemberNames();
+            for (const auto& diff : difficulties)
+            {
+                const Json::Value& customratio = json["item_pool_ratio"][diff];
+                int diff_int = std::stoi(diff);
+
+                info.item_pool_ratio[diff_int].push_back(customratio.get("helpful", 0).asInt());
+                info.item_pool_ratio[diff_int].push_back(customratio.get("random", 0).asInt());
+            }
+        }
+    }
+}
+
+// The tables are built in (see embed_json.cmake), so nothing is read from disk.
+// For working on them, --default-json <folder> loads any of them found in that folder instead.
+static bool load_default_json(Json::Value& json, const std::string& filename, const unsigned char* data, size_t size)
+{
+    for (int i = 0; i + 1 < (int)core_arguments.size(); ++i)
+    {
+        if (core_arguments[i] == "--default-json")
+        {
+            std::string path = core_arguments[i + 1] + "/" + filename;
+            if (std::filesystem::exists(path))
+            {
+                log_info("Using " + path + " instead of the built-in " + filename);
+                return load_json_file(json, path);
+            }
+        }
+    }
+
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    std::string errors;
+    return reader->parse((const char*)data, (const char*)data + size, &json, &errors);
+}
 
 void init_data()
 {
-    if (!onut::loadJson(default_game_infos, "./assets/json/default_game_info.json"))
+    Json::Value game_infos_json;
+    Json::Value world_infos_json;
+    Json::Value items_json;
+    Json::Value locations_json;
+
+    if (!load_default_json(game_infos_json, "default_game_info.json", embedded_default_game_info_json, embedded_default_game_info_json_size))
         OnScreenMessages::AddError("default_game_info.json couldn't be loaded, expect issues.");
-    if (!onut::loadJson(default_world_infos, "./assets/json/default_world_info.json"))
+    if (!load_default_json(world_infos_json, "default_world_info.json", embedded_default_world_info_json, embedded_default_world_info_json_size))
         OnScreenMessages::AddError("default_world_info.json couldn't be loaded, expect issues.");
-    if (!onut::loadJson(default_items, "./assets/json/default_items.json"))
+    if (!load_default_json(items_json, "default_items.json", embedded_default_items_json, embedded_default_items_json_size))
         OnScreenMessages::AddError("default_items.json couldn't be loaded, expect issues.");
-    if (!onut::loadJson(default_locations, "./assets/json/default_locations.json"))
+    if (!load_default_json(locations_json, "default_locations.json", embedded_default_locations_json, embedded_default_locations_json_size))
         OnScreenMessages::AddError("default_locations.json couldn't be loaded, expect issues.");
+
+    for (const auto& iwad : game_infos_json.getMemberNames())
+        default_game_infos[iwad] = game_infos_json[iwad];
+    for (const auto& iwad : world_infos_json.getMemberNames())
+        parse_world_info(default_world_infos[iwad], world_infos_json[iwad]);
+    for (const auto& iwad : items_json.getMemberNames())
+        parse_item_tables(default_items[iwad], items_json[iwad]);
+    for (const auto& iwad : locations_json.getMemberNames())
+    {
+        const auto& doomtype_to_location = locations_json[iwad];
+        for (const auto& doomtype : doomtype_to_location.getMemberNames())
+            default_locations[iwad][std::stoi(doomtype)] = doomtype_to_location[doomtype].asString();
+    }
 }
 
-void init_worlds(std::vector<std::string> game_json_files, bool summarize)
+static bool wad_exists(const std::string& filename)
 {
-    long start_time = (summarize ? get_runtime_us() : 0);
-    int loaded_count = 0;
+    return std::filesystem::exists(filename) || std::filesystem::exists("wads/" + filename);
+}
 
-    for (const auto& game_json_file : game_json_files)
+// Only reads what's needed to list the game, skipping over everything else
+static bool catalog_game(const std::string& game_json_file, game_catalog_entry_t& entry)
+{
+    auto data = read_file_data(game_json_file);
+    JsonPullReader reader((const char*)data.data(), data.size());
+    std::string key;
+    std::string ap_name = "Unnamed id1 Game";
+    bool has_short_name = false, has_iwad = false, has_episodes = false;
+
+    entry.path = game_json_file;
+    if (!reader.BeginObject()) return false;
+    while (reader.NextKey(key))
     {
-        if (!summarize)
-            start_time = get_runtime_us();
-
-        Json::Value game_json;
-        if (!onut::loadJson(game_json, game_json_file))
+        if (key == "short_name") { entry.short_name = reader.GetString(); has_short_name = true; }
+        else if (key == "iwad") { entry.iwad_name = reader.GetString(); has_iwad = true; }
+        else if (key == "ap_name") ap_name = reader.GetString(ap_name);
+        else if (key == "full_name") entry.full_name = reader.GetString();
+        else if (key == "required_wads")
         {
-            OnScreenMessages::AddError(
-                "Can't load '" + game_json_file + "': Json parse error.\n"
-                "The terminal may have further information about this error.");
-            continue;
+            // String or array of strings, like stringarray_to_vector()
+            if (reader.IsString())
+            {
+                entry.required_wads.push_back(reader.GetString());
+                continue;
+            }
+            if (!reader.BeginArray()) continue;
+            while (reader.NextElement())
+                entry.required_wads.push_back(reader.GetString());
         }
+        else if (key == "episodes")
+        {
+            if (!reader.BeginArray()) continue;
+            has_episodes = true;
+            while (reader.NextElement())
+            {
+                entry.episode_names.push_back("Episode " + std::to_string(entry.episode_names.size() + 1));
+                entry.map_names.emplace_back();
+                if (!reader.BeginObject()) continue;
+                while (reader.NextKey(key))
+                {
+                    if (key == "name") entry.episode_names.back() = reader.GetString();
+                    else if (key == "maps")
+                    {
+                        if (!reader.BeginArray()) continue;
+                        while (reader.NextElement())
+                        {
+                            entry.map_names.back().emplace_back();
+                            if (!reader.BeginObject()) continue;
+                            while (reader.NextKey(key))
+                            {
+                                if (key == "name") entry.map_names.back().back() = reader.GetString();
+                                else reader.Skip();
+                            }
+                        }
+                    }
+                    else reader.Skip();
+                }
+            }
+        }
+        else reader.Skip();
+    }
+    if (reader.Failed() || !has_short_name || !has_iwad || !has_episodes)
+        return false;
+    if (entry.full_name.empty())
+        entry.full_name = ap_name;
+
+    // Can't be opened without these
+    std::vector<std::string> wads = {entry.iwad_name};
+    for (const auto& pwad : entry.required_wads)
+        if (pwad.size() > 4 && to_lower(pwad.substr(pwad.size() - 4)) == ".wad")
+            wads.push_back(pwad);
+    for (const auto& wad : wads)
+    {
+        if (!wad_exists(wad))
+        {
+            entry.missing_wad = wad;
+            break;
+        }
+    }
+    return true;
+}
 
-        if (
-            // Test required fields
-            !game_json["short_name"].isString()
-            || !game_json["iwad"].isString()
-            || !game_json["episodes"].isArray()
-        )
+std::vector<std::string> find_game_jsons(const std::string& folder)
+{
+    constexpr std::string_view extension{".GAME.JSON"};
+    std::vector<std::string> allFiles = find_files(folder);
+    std::vector<std::string> filteredFiles;
+    for (auto file : allFiles)
+    {
+        if (file.size() > extension.size() &&
+            to_upper(file.substr(file.size() - extension.size())) == extension)
         {
-            OnScreenMessages::AddError(
-                "Can't load '" + game_json_file + "': Missing required fields.\n"
-                "The terminal may have further information about this error.");
-            printf("%s : Missing a required field.\n"
-                "  At minimum, the following fields are required:\n"
-                "  - short_name (string)\n"
-                "  - iwad (string)\n"
-                "  - episodes (array of objects)\n",
-                game_json_file.c_str());
-            continue;
+            filteredFiles.emplace_back(file);
         }
+    }
+    return filteredFiles;
+}
 
-        game_t game;
+// What a loaded game was built from: its .game.json, its wads, and its .data.json last.
+// Same lookup as when the wads get opened.
+std::vector<std::string> get_game_files(const game_t* game)
+{
+    std::vector<std::string> paths = {game->path};
+    std::vector<std::string> wads = {game->iwad_name};
+    for (const auto& pwad : game->required_wads)
+        if (pwad.size() > 4 && to_lower(pwad.substr(pwad.size() - 4)) == ".wad")
+            wads.push_back(pwad);
+    for (const auto& wad : wads)
+        paths.push_back(std::filesystem::exists(wad) ? wad : "wads/" + wad);
+    paths.push_back("data/" + game->short_name + ".data.json");
+    return paths;
+}
 
-        // The short name is used as a key, so check its value first. Don't load duplicate games.
-        game.short_name = game_json["short_name"].asString();
-        if (games.count(game.short_name))
+// Lists the games, they get loaded once opened
+void catalog_games(const std::vector<std::string>& game_json_files)
+{
+    long start_time = get_runtime_us();
+    int listed_count = 0;
+
+    for (const auto& game_json_file : game_json_files)
+    {
+        game_catalog_entry_t entry;
+        if (!catalog_game(game_json_file, entry))
         {
             OnScreenMessages::AddError(
-                "Can't load '" + game_json_file + "': Game is already loaded.\n"
-                "(" + games[game.short_name].path + " has the same short name.)");
+                "Can't load '" + game_json_file + "': Json parse error or missing required fields.\n"
+                "At minimum, short_name (string), iwad (string) and episodes (array of objects) are required.");
             continue;
         }
-        game.path = game_json_file;
-
-        // The name of the game, in various forms.
-        game.ap_name = game_json.get("ap_name", "Unnamed id1 Game").asString();
-        game.ap_world_name = game_json.get("ap_world_name", "id1_game").asString();
-        game.ap_class_name = game_json.get("ap_class_name", "id1Game").asString();
-        game.full_name = game_json.get("full_name", game.ap_name).asString();
-        stringarray_to_vector(game.authors, game_json["authors"]);
-        update_window_title("Loading " + game.full_name + "...");
-
-        game.iwad_name = game_json["iwad"].asString(); // The IWAD, lumps get loaded from this if missing in PWAD
-        stringarray_to_vector(game.required_wads, game_json["required_wads"]);
-        stringarray_to_vector(game.optional_wads, game_json["optional_wads"]);
-        stringarray_to_vector(game.included_wads, game_json["included_wads"]);
-
-        std::string primary_wad = game.iwad_name;
-        if (!game.required_wads.empty())
+
+        // The short name is used as a key. Don't list duplicate games.
+        auto it = game_catalog.find(entry.short_name);
+        if (it != game_catalog.end())
         {
-            // Assume that if a PWAD is required, the maps we want to analyze come from that PWAD by default.
-            primary_wad = game.required_wads[0];
+            if (it->second.path != game_json_file)
+                OnScreenMessages::AddError(
+                    "Can't load '" + game_json_file + "': Game is already loaded.\n"
+                    "(" + it->second.path + " has the same short name.)");
+            continue;
         }
 
-        if (!game_json["settings"].isNull())
+        if (!entry.missing_wad.empty())
+            OnScreenMessages::AddWarning("'" + entry.full_name + "' needs '" + entry.missing_wad + "', which wasn't found.");
+        game_catalog.emplace(entry.short_name, std::move(entry));
+        ++listed_count;
+    }
+
+    OnScreenMessages::AddNotice("Listed " + std::to_string(listed_count) + " game(s) (" + compare_runtime(start_time) + " sec)");
+}
+
+// Walks every list once, so nothing has to search them per thing or per requirement after
+static void build_doom_type_table(game_t& game)
+{
+    auto& table = game.doom_types;
+    table = doom_type_table_t();
+
+    const std::pair<item_category_t, const std::vector<ap_item_def_t>*> categories[] = {
+        {item_category_t::progression, &game.progression},
+        {item_category_t::useful, &game.useful},
+        {item_category_t::filler, &game.filler},
+        {item_category_t::unique_progression, &game.unique_progression},
+        {item_category_t::unique_useful, &game.unique_useful},
+        {item_category_t::unique_filler, &game.unique_filler},
+    };
+
+    int lowest = 0, highest = -1;
+    auto fit = [&](int doom_type)
+    {
+        lowest = std::min(lowest, doom_type);
+        highest = std::max(highest, doom_type);
+    };
+    for (const auto& kv : game.location_doom_types)
+        fit(kv.first);
+    for (const auto& category : categories)
+        for (const auto& item : *category.second)
+            fit(item.doom_type);
+    for (const auto& key : game.keys)
+        fit(key.item.doom_type);
+    for (const auto& requirement : game.item_requirements)
+        fit(requirement.doom_type);
+    table.types.resize(highest + 1);
+    table.special_types.resize(1 - lowest);
+
+    auto info = [&](int doom_type) -> doom_type_info_t&
+    {
+        return doom_type >= 0 ? table.types[doom_type] : table.special_types[-doom_type];
+    };
+    auto index_first = [&](const std::vector<ap_item_def_t>& items, int16_t doom_type_info_t::* index)
+    {
+        for (int i = 0; i < (int)items.size(); ++i)
+            if (info(items[i].doom_type).*index == -1)
+                info(items[i].doom_type).*index = (int16_t)i;
+    };
+
+    for (const auto& kv : game.location_doom_types)
+    {
+        info(kv.first).location = (int16_t)table.location_names.size();
+        table.location_names.push_back(kv.second);
+    }
+    for (const auto& category : categories) // In the order get_item_name() has always looked
+    {
+        for (int i = 0; i < (int)category.second->size(); ++i)
         {
-            game.check_sanity = game_json["settings"].get("check_sanity", false).asBool();
-            game.extended_names = game_json["settings"].get("extended_names", false).asBool();
+            auto& type_info = info((*category.second)[i].doom_type);
+            if (type_info.item_category != item_category_t::none)
+                continue;
+            type_info.item_category = category.first;
+            type_info.item = (int16_t)i;
         }
+    }
+    for (int i = 0; i < (int)game.keys.size(); ++i)
+    {
+        auto& type_info = info(game.keys[i].item.doom_type);
+        if (type_info.key != -1)
+            continue;
+        type_info.key = (int16_t)i;
+        type_info.key_slot = (int8_t)game.keys[i].key;
+    }
+    index_first(game.unique_progression, &doom_type_info_t::unique_progression);
+    index_first(game.item_requirements, &doom_type_info_t::item_requirement);
+    index_first(game.extra_connection_requirements, &doom_type_info_t::extra_connection_requirement);
+}
 
-        game.ep_count = (int)game_json["episodes"].size();
-        game.episodes.resize(game.ep_count);
-        game.episode_info.resize(game.ep_count);
+// Everything else about a game: its full .game.json, wads and maps. Runs on a loading thread,
+// so problems are returned instead of shown. When reloading, levels whose lumps hash the same
+// as in 'previous_hashes' (by lump name) are left for the caller to carry over.
+bool init_game(const std::string& game_json_file, game_t& game, std::vector<std::string>& errors,
+    const std::map<std::string, uint64_t>* previous_hashes, bool headless)
+{
+    Json::Value game_json;
+    if (!load_json_file(game_json, game_json_file))
+    {
+        errors.push_back(
+            "Can't load '" + game_json_file + "': Json parse error.\n"
+            "The terminal may have further information about this error.");
+        return false;
+    }
 
-        int ep = 0;
-        for (const auto &episode_json : game_json["episodes"])
-        {
-            game.episode_info[ep].name = episode_json.get("name", "Episode " + std::to_string(ep + 1)).asString();
-            game.episode_info[ep].description = episode_json.get("description", "").asString();
-            game.episode_info[ep].is_minor_episode = episode_json.get("minor", false).asBool();
-            game.episode_info[ep].default_enabled = episode_json.get("default", true).asBool();
+    if (
+        // Test required fields
+        !game_json["short_name"].isString()
+        || !game_json["iwad"].isString()
+        || !game_json["episodes"].isArray()
+    )
+    {
+        errors.push_back(
+            "Can't load '" + game_json_file + "': Missing required fields.\n"
+            "The terminal may have further information about this error.");
+        printf("%s : Missing a required field.\n"
+            "  At minimum, the following fields are required:\n"
+            "  - short_name (string)\n"
+            "  - iwad (string)\n"
+            "  - episodes (array of objects)\n",
+            game_json_file.c_str());
+        return false;
+    }
 
-            if (episode_json["maps"].isArray())
-            {
-                int map = 0;
+    game.short_name = game_json["short_name"].asString();
+    game.path = game_json_file;
 
-                game.episodes[ep].resize(episode_json["maps"].size());
-                for (const auto& mapname_json : episode_json["maps"])
-                {
-                    game.episodes[ep][map].name = mapname_json["name"].asString();
-                    game.episodes[ep][map].lump_name = mapname_json["lump"].asString();
-                    game.episodes[ep][map].wad_name = (mapname_json["wad"].isNull() ? primary_wad : mapname_json["wad"].asString());
-                    game.episodes[ep][map].music_override = mapname_json.get("music", "").asString();
-                    ++map;
-                }
-                if (!game.episode_info[ep].is_minor_episode)
-                {
-                    game.episode_info[ep].starting_level = episode_json.get("start_level", 1).asInt();
-                    game.episode_info[ep].boss_level =  episode_json.get("boss_level", map).asInt();                    
-                }
-            }
-            ++ep;
-        }
+    // The name of the game, in various forms.
+    game.ap_name = game_json.get("ap_name", "Unnamed id1 Game").asString();
+    game.ap_world_name = game_json.get("ap_world_name", "id1_game").asString();
+    game.ap_class_name = game_json.get("ap_class_name", "id1Game").asString();
+    game.full_name = game_json.get("full_name", game.ap_name).asString();
+    stringarray_to_vector(game.authors, game_json["authors"]);
 
-        const Json::Value& doomtype_to_location = (game_json["location_doom_types"].isObject())
-            ? (game_json["location_doom_types"])
-            : (default_locations[game.iwad_name]);
-        for (const auto& doomtype : doomtype_to_location.getMemberNames())
-            game.location_doom_types[std::stoi(doomtype)] = doomtype_to_location[doomtype].asString();
+    game.iwad_name = game_json["iwad"].asString(); // The IWAD, lumps get loaded from this if missing in PWAD
+    stringarray_to_vector(game.required_wads, game_json["required_wads"]);
+    stringarray_to_vector(game.optional_wads, game_json["optional_wads"]);
+    stringarray_to_vector(game.included_wads, game_json["included_wads"]);
 
-        // Merge in default items for iwad
-        Json::Value item_json = default_items.get(game.iwad_name, Json::objectValue);
-        if (game_json["items"].isObject())
-        {
-            for (const auto &element : game_json["items"].getMemberNames())
-                item_json[element] = game_json["items"][element];
-        }
+    std::string primary_wad = game.iwad_name;
+    if (!game.required_wads.empty())
+    {
+        // Assume that if a PWAD is required, the maps we want to analyze come from that PWAD by default.
+        primary_wad = game.required_wads[0];
+    }
 
-        parse_items(game.extra_connection_requirements, item_json["extra_connection_requirements"]);
-        parse_items(game.progression, item_json["progression"]);
-        parse_items(game.useful, item_json["useful"]);
-        parse_items(game.filler, item_json["filler"]);
-        parse_items(game.unique_progression, item_json["unique_progression"]);
-        parse_items(game.unique_useful, item_json["unique_useful"]);
-        parse_items(game.unique_filler, item_json["unique_filler"]);
+    if (!game_json["settings"].isNull())
+    {
+        game.check_sanity = game_json["settings"].get("check_sanity", false).asBool();
+        game.extended_names = game_json["settings"].get("extended_names", false).asBool();
+    }
 
-        for (const auto& key_json : item_json["keys"])
-        {
-            ap_key_def_t item;
-            parse_item(item.item, key_json);
-            item.key = key_json["key"].asInt();
-            item.use_skull = key_json["use_skull"].asBool();
-            item.region_name = key_json["region_name"].asString();
-            item.color = Color(key_json["color"][0].asFloat(), key_json["color"][1].asFloat(), key_json["color"][2].asFloat());
-            game.key_colors[item.key] = item.color;
-            game.keys.push_back(item);
-        }
+    game.ep_count = (int)game_json["episodes"].size();
+    game.episodes.resize(game.ep_count);
+    game.episode_info.resize(game.ep_count);
 
-        game.item_requirements.insert(game.item_requirements.end(), game.extra_connection_requirements.begin(), game.extra_connection_requirements.end());
-        game.item_requirements.insert(game.item_requirements.end(), game.progression.begin(), game.progression.end());
-        game.item_requirements.insert(game.item_requirements.end(), game.unique_progression.begin(), game.unique_progression.end());
-        for (const auto& key : game.keys)
-            game.item_requirements.push_back(key.item);
+    int ep = 0;
+    for (const auto &episode_json : game_json["episodes"])
+    {
+        game.episode_info[ep].name = episode_json.get("name", "Episode " + std::to_string(ep + 1)).asString();
+        game.episode_info[ep].description = episode_json.get("description", "").asString();
+        game.episode_info[ep].is_minor_episode = episode_json.get("minor", false).asBool();
+        game.episode_info[ep].default_enabled = episode_json.get("default", true).asBool();
 
-        // Merge in default world data for iwad
-        Json::Value world_json = default_world_infos.get(game.iwad_name, Json::objectValue);
-        if (game_json["world_info"].isObject())
+        if (episode_json["maps"].isArray())
         {
-            for (const auto &element : game_json["world_info"].getMemberNames())
-                world_json[element] = game_json["world_info"][element];
-        }
-        if (!world_json.empty())
-        {
-            // World description: used as the docstring for the world class
-            stringarray_to_vector(game.description, world_json["description"]);
+            int map = 0;
 
-            // World options: Automatic addition of common hooks and options
-            game.json_world_options = Json::arrayValue;
-            if (world_json["world_options"].isArray())
-                game.json_world_options = world_json["world_options"];
-
-            // World hooks: allows some extra python code in certain places, if necessary
-            if (world_json["hooks"].isObject())
+            game.episodes[ep].resize(episode_json["maps"].size());
+            for (const auto& mapname_json : episode_json["maps"])
             {
-                const auto& hook_types = world_json["hooks"].getMemberNames();
-                for (const auto& hook_type : hook_types)
-                    stringarray_to_vector(game.world_hooks[hook_type], world_json["hooks"][hook_type]);
+                game.episodes[ep][map].name = mapname_json["name"].asString();
+                game.episodes[ep][map].lump_name = mapname_json["lump"].asString();
+                game.episodes[ep][map].wad_name = (mapname_json["wad"].isNull() ? primary_wad : mapname_json["wad"].asString());
+                game.episodes[ep][map].music_override = mapname_json.get("music", "").asString();
+                ++map;
             }
-
-            // Helpful item weights: Lets worlds have a weighted "helpful" filler pool
-            if (world_json["helpful_item_weight"].isObject())
+            if (!game.episode_info[ep].is_minor_episode)
             {
-                const auto& item_names = world_json["helpful_item_weight"].getMemberNames();
-                for (const auto& item_name : item_names)
-                    game.helpful_item_weight.try_emplace(item_name, world_json["helpful_item_weight"][item_name].asInt());
+                game.episode_info[ep].starting_level = episode_json.get("start_level", 1).asInt();
+                game.episode_info[ep].boss_level =  episode_json.get("boss_level", map).asInt();                    
             }
+        }
+        ++ep;
+    }
 
-            // Item pool ratio: Size of the helpful and random pools relative to number of locations
-            if (world_json["item_pool_ratio"].isObject())
-            {
-                const auto& difficulties = world_json["item_pool_ratio"].getMemberNames();
-                for (const auto& diff : difficulties)
-                {
-                    const Json::Value& customratio = world_json["item_pool_ratio"][diff];
-                    int diff_int = std::stoi(diff);
+    if (game_json["location_doom_types"].isObject())
+    {
+        const Json::Value& doomtype_to_location = game_json["location_doom_types"];
+        for (const auto& doomtype : doomtype_to_location.getMemberNames())
+            game.location_doom_types[std::stoi(doomtype)] = doomtype_to_location[doomtype].asString();
+    }
+    else
+    {
+        auto it = default_locations.find(game.iwad_name);
+        if (it != default_locations.end())
+            game.location_doom_types = it->second;
+    }
 
-                    game.item_pool_ratio[diff_int].push_back(customratio.get("helpful", 0).asInt());
-                    game.item_pool_ratio[diff_int].push_back(customratio.get("random", 0).asInt());
-                }
-            }
-        }
-        if (game.description.empty())
-            game.description.push_back("%NAME% is a game playable with APDoom version 2.0.0.");
+    // Merge in default items for iwad
+    item_tables_t items;
+    {
+        auto it = default_items.find(game.iwad_name);
+        if (it != default_items.end())
+            items = it->second;
+    }
+    parse_item_tables(items, game_json["items"]);
+
+    game.extra_connection_requirements = std::move(items.extra_connection_requirements);
+    game.progression = std::move(items.progression);
+    game.useful = std::move(items.useful);
+    game.filler = std::move(items.filler);
+    game.unique_progression = std::move(items.unique_progression);
+    game.unique_useful = std::move(items.unique_useful);
+    game.unique_filler = std::move(items.unique_filler);
+    for (const auto& key : items.keys)
+    {
+        game.key_colors[key.key] = key.color;
+        game.keys.push_back(key);
+    }
 
-        // Substitute %NAME% in the description with the game's name.
-        for (std::string &descline : game.description)
-        {
-            if (descline.empty())
-                continue;
-            constexpr std::string_view name_str{"%NAME%"};
-            size_t name_marker = descline.find(name_str);
+    game.item_requirements.insert(game.item_requirements.end(), game.extra_connection_requirements.begin(), game.extra_connection_requirements.end());
+    game.item_requirements.insert(game.item_requirements.end(), game.progression.begin(), game.progression.end());
+    game.item_requirements.insert(game.item_requirements.end(), game.unique_progression.begin(), game.unique_progression.end());
+    for (const auto& key : game.keys)
+        game.item_requirements.push_back(key.item);
+    build_doom_type_table(game);
 
-            if (name_marker != std::string::npos)
-                descline.replace(name_marker, name_str.size(), game.full_name);
-        }
+    // Merge in default world data for iwad
+    world_info_t world_info;
+    {
+        auto it = default_world_infos.find(game.iwad_name);
+        if (it != default_world_infos.end())
+            world_info = it->second;
+    }
+    parse_world_info(world_info, game_json["world_info"]);
+    if (world_info.present)
+    {
+        game.description = std::move(world_info.description);
+        game.json_world_options = std::move(world_info.world_options);
+        game.world_hooks = std::move(world_info.hooks);
+        game.helpful_item_weight = std::move(world_info.helpful_item_weight);
+        game.item_pool_ratio = std::move(world_info.item_pool_ratio);
+    }
+    if (game.description.empty())
+        game.description.push_back("%NAME% is a game playable with APDoom version 2.0.0.");
 
-        // Merge in default game data for iwad with whatever is present in game json
-        game.json_game_info = default_game_infos.get(game.iwad_name, Json::objectValue);
-        if (game_json["game_info"].isObject())
-        {
-            for (const auto &element : game_json["game_info"].getMemberNames())
-                game.json_game_info[element] = game_json["game_info"][element];
-        }
+    // Substitute %NAME% in the description with the game's name.
+    for (std::string &descline : game.description)
+    {
+        if (descline.empty())
+            continue;
+        constexpr std::string_view name_str{"%NAME%"};
+        size_t name_marker = descline.find(name_str);
 
-        // Sections reserved unchanged
-        game.json_rename_lumps = game_json["rename_lumps"];
-        game.json_map_tweaks = game_json["map_tweaks"];
-        game.json_level_select = game_json["level_select"];
-        game.loaded = false; // .data.json isn't loaded yet
+        if (name_marker != std::string::npos)
+            descline.replace(name_marker, name_str.size(), game.full_name);
+    }
 
-        if (init_maps(game))
-        {
-            games[game.short_name] = game;
-            if (!summarize)
-                OnScreenMessages::AddNotice("Loaded game '" + game.full_name + "' (" + compare_runtime(start_time) + " sec)");
-            ++loaded_count;
-        }
-        else
-        {
-            OnScreenMessages::AddError(
-                "Can't load '" + game_json_file + "': Wad files missing.\n"
-                "The terminal may have further information about this error.");
-        }
+    // Merge in default game data for iwad with whatever is present in game json
+    // (Kept as json, it goes to the output as is)
+    {
+        auto it = default_game_infos.find(game.iwad_name);
+        game.json_game_info = (it != default_game_infos.end()) ? it->second : Json::Value(Json::objectValue);
+    }
+    if (game_json["game_info"].isObject())
+    {
+        for (const auto &element : game_json["game_info"].getMemberNames())
+            game.json_game_info[element] = game_json["game_info"][element];
+    }
+
+    // Sections reserved unchanged
+    game.json_rename_lumps = game_json["rename_lumps"];
+    game.json_map_tweaks = game_json["map_tweaks"];
+    game.json_level_select = game_json["level_select"];
+    game.loaded = false; // .data.json isn't loaded yet
+
+    if (!init_maps(game, previous_hashes, headless))
+    {
+        errors.push_back(
+            "Can't load '" + game_json_file + "': Wad files missing.\n"
+            "The terminal may have further information about this error.");
+        return false;
     }
-    if (summarize)
-        OnScreenMessages::AddNotice("Loaded " + std::to_string(loaded_count) + " game(s) (" + compare_runtime(start_time) + " sec)");
+    return true;
 }
 
 
@@ -352,8 +703,8 @@ map_state_t* get_state(const level_index_t& idx, active_source_t source)
     if (!game) return nullptr;
     if (idx.ep < 0 || idx.ep >= (int)game->episodes.size()) return nullptr;
     if (idx.map < 0 || idx.map >= (int)game->episodes[idx.ep].size()) return nullptr;
-    if (source == active_source_t::current ||
-        source == active_source_t::target) return &game->episodes[idx.ep][idx.map].state;
+    if (source == active_source_t::current) return &game->episodes[idx.ep][idx.map].state;
+    if (source == active_source_t::target) return &game->episodes[idx.ep][idx.map].state_new;
     return nullptr;
 }
 
@@ -376,33 +727,193 @@ const std::string& get_level_name(const level_index_t& idx)
     return game->episodes[idx.ep][idx.map].name;
 }
 
-static inline int get_item_index(const std::vector<ap_item_def_t>& items, int doom_type)
+#define BB_INDEX_NODE_SIZE 8
+
+static void fit_bb_node(bb_index_node_t& node, const bb_t& bb)
+{
+    // Boxes being dragged can be inverted for a moment
+    node.x1 = std::min(node.x1, std::min(bb.x1, bb.x2));
+    node.y1 = std::min(node.y1, std::min(bb.y1, bb.y2));
+    node.x2 = std::max(node.x2, std::max(bb.x1, bb.x2));
+    node.y2 = std::max(node.y2, std::max(bb.y1, bb.y2));
+}
+
+static void fit_bb_node(bb_index_node_t& node, const bb_index_node_t& child)
+{
+    node.x1 = std::min(node.x1, child.x1);
+    node.y1 = std::min(node.y1, child.y1);
+    node.x2 = std::max(node.x2, child.x2);
+    node.y2 = std::max(node.y2, child.y2);
+}
+
+void bb_index_t::build(const std::vector<bb_t>& bbs)
 {
-    for (int i = 0; i < (int)items.size(); ++i)
+    dirty = false;
+    levels.clear();
+    int count = (int)bbs.size();
+    items.resize(count);
+    item_leaf.resize(count);
+    if (count == 0) return;
+
+    // Sort-tile-recursive packing: slice by x, then group each slice by y
+    for (int i = 0; i < count; ++i) items[i] = i;
+    std::sort(items.begin(), items.end(), [&bbs](int a, int b) { return bbs[a].x1 + bbs[a].x2 < bbs[b].x1 + bbs[b].x2; });
+    int leaf_count = (count + BB_INDEX_NODE_SIZE - 1) / BB_INDEX_NODE_SIZE;
+    int slice_count = (int)std::ceil(std::sqrt((double)leaf_count));
+    int slice_size = slice_count * BB_INDEX_NODE_SIZE;
+    for (int i = 0; i < count; i += slice_size)
+    {
+        std::sort(items.begin() + i, items.begin() + std::min(i + slice_size, count), [&bbs](int a, int b) { return bbs[a].y1 + bbs[a].y2 < bbs[b].y1 + bbs[b].y2; });
+    }
+
+    const bb_index_node_t empty = {INT_MAX, INT_MAX, INT_MIN, INT_MIN, 0, 0};
+    levels.emplace_back();
+    for (int i = 0; i < count; i += BB_INDEX_NODE_SIZE)
     {
-        if (items[i].doom_type == doom_type)
+        auto node = empty;
+        node.first = i;
+        node.count = std::min(BB_INDEX_NODE_SIZE, count - i);
+        for (int j = i; j < i + node.count; ++j)
+        {
+            fit_bb_node(node, bbs[items[j]]);
+            item_leaf[items[j]] = (int)levels[0].size();
+        }
+        levels[0].push_back(node);
+    }
+
+    // Children of a node are contiguous, so a node's parent is simply its index / BB_INDEX_NODE_SIZE
+    while (levels.back().size() > 1)
+    {
+        std::vector<bb_index_node_t> parents;
+        const auto& children = levels.back();
+        for (int i = 0; i < (int)children.size(); i += BB_INDEX_NODE_SIZE)
+        {
+            auto node = empty;
+            node.first = i;
+            node.count = std::min(BB_INDEX_NODE_SIZE, (int)children.size() - i);
+            for (int j = i; j < i + node.count; ++j)
+                fit_bb_node(node, children[j]);
+            parents.push_back(node);
+        }
+        levels.push_back(std::move(parents));
+    }
+}
+
+void bb_index_t::moved(const std::vector<bb_t>& bbs, int bb)
+{
+    if (dirty || bb < 0 || bb >= (int)item_leaf.size()) return;
+
+    // Bounds only grow here, which keeps queries correct until the next rebuild tightens them
+    int node = item_leaf[bb];
+    fit_bb_node(levels[0][node], bbs[bb]);
+    for (int l = 1; l < (int)levels.size(); ++l)
+    {
+        fit_bb_node(levels[l][node / BB_INDEX_NODE_SIZE], levels[l - 1][node]);
+        node /= BB_INDEX_NODE_SIZE;
+    }
+}
+
+void bb_index_t::query(const std::vector<bb_t>& bbs, int x1, int y1, int x2, int y2, std::vector<int>& out)
+{
+    out.clear();
+    if (dirty || items.size() != bbs.size()) build(bbs);
+    if (levels.empty()) return;
+
+    struct stack_entry_t { int level, node; };
+    static thread_local std::vector<stack_entry_t> stack;
+    stack.clear();
+    stack.push_back({(int)levels.size() - 1, 0});
+    while (!stack.empty())
+    {
+        auto entry = stack.back();
+        stack.pop_back();
+        const auto& node = levels[entry.level][entry.node];
+        if (node.x2 < x1 || node.x1 > x2 || node.y2 < y1 || node.y1 > y2) continue;
+        if (entry.level == 0)
+        {
+            for (int i = node.first; i < node.first + node.count; ++i)
+            {
+                const auto& bb = bbs[items[i]];
+                if (std::max(bb.x1, bb.x2) < x1 || std::min(bb.x1, bb.x2) > x2 ||
+                    std::max(bb.y1, bb.y2) < y1 || std::min(bb.y1, bb.y2) > y2) continue;
+                out.push_back(items[i]);
+            }
+        }
+        else
+        {
+            for (int i = node.first; i < node.first + node.count; ++i)
+                stack.push_back({entry.level - 1, i});
+        }
+    }
+
+    // Callers rely on getting the same box a linear scan would have found first
+    std::sort(out.begin(), out.end());
+}
+
+int map_state_t::get_override_bb_at(int x, int y)
+{
+    static thread_local std::vector<int> candidates;
+    bb_index.query(bbs, x, y, x, y, candidates);
+    for (int i : candidates)
+    {
+        const auto& bb = bbs[i];
+        if (bb.region > -1 && bb.region < (int)regions.size() && bb.point_inside(x, y))
             return i;
     }
     return -1;
 }
 
+
+// A sector held by more than one region only ever counted for the first one,
+// so it's dropped from the others here.
+void map_state_t::rebuild_sector_regions(int sector_count)
+{
+    sector_region.assign(sector_count, -1);
+    for (int r = 0; r < (int)regions.size(); ++r)
+    {
+        auto& sectors = regions[r].sectors;
+        for (auto sectori : sectors)
+        {
+            if (sectori >= sector_count) break;
+            if (sector_region[sectori] != -1)
+                sectors.erase(sectori);
+            else
+                sector_region[sectori] = (int16_t)r;
+        }
+    }
+}
+
+void map_state_t::set_sector_region(int sector, int region)
+{
+    if (sector < 0) return;
+    if (sector >= (int)sector_region.size())
+        sector_region.resize(sector + 1, -1);
+
+    int previous = sector_region[sector];
+    if (previous == region) return;
+    if (previous != -1)
+        regions[previous].sectors.erase(sector);
+    if (region != -1)
+        regions[region].sectors.insert(sector);
+    sector_region[sector] = (int16_t)region;
+}
+
+
 const std::string& get_item_name(game_t *game, int doom_type)
 {
     static std::string no_item_str = "(no item)";
 
-    int ret;
-    if ((ret = get_item_index(game->progression, doom_type)) != -1)
-        return game->progression[ret].name;
-    if ((ret = get_item_index(game->useful, doom_type)) != -1)
-        return game->useful[ret].name;
-    if ((ret = get_item_index(game->filler, doom_type)) != -1)
-        return game->filler[ret].name;
-    if ((ret = get_item_index(game->unique_progression, doom_type)) != -1)
-        return game->unique_progression[ret].name;
-    if ((ret = get_item_index(game->unique_useful, doom_type)) != -1)
-        return game->unique_useful[ret].name;
-    if ((ret = get_item_index(game->unique_filler, doom_type)) != -1)
-        return game->unique_filler[ret].name;
+    const auto& type_info = game->doom_types[doom_type];
+    switch (type_info.item_category)
+    {
+    case item_category_t::progression: return game->progression[type_info.item].name;
+    case item_category_t::useful: return game->useful[type_info.item].name;
+    case item_category_t::filler: return game->filler[type_info.item].name;
+    case item_category_t::unique_progression: return game->unique_progression[type_info.item].name;
+    case item_category_t::unique_useful: return game->unique_useful[type_info.item].name;
+    case item_category_t::unique_filler: return game->unique_filler[type_info.item].name;
+    case item_category_t::none: break;
+    }
     return no_item_str;
 }
 
@@ -2,14 +2,18 @@
 
 #define APGENTOOL_VERSION "2.0.20260626"
 
-#include <onut/Maths.h>
-#include <onut/Vector2.h>
-#include <onut/Texture.h>
 #include <json/json.h>
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <set>
 #include <map>
+#include <memory>
+#include <cstdint>
+#include <stdio.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 #include "maps.h"
 
 
@@ -70,13 +74,13 @@ struct bb_t
         auto d4 = y2 - other.y1;
         if (d4 < 0) return 0;
 
-        return onut::max(d1, d2, d3, d4);
+        return std::max({d1, d2, d3, d4});
 
         //return (x1 <= other.x2 && x2 >= other.x1 && 
         //        y1 <= other.y2 && y2 >= other.y1);
     }
 
-    bb_t operator+(const Vector2& v) const
+    bb_t operator+(const vec2_t& v) const
     {
         return {
             (int)(x1 + v.x),
@@ -86,7 +90,7 @@ struct bb_t
         };
     }
 
-    Vector2 center() const
+    vec2_t center() const
     {
         return {
             (float)(x1 + x2) * 0.5f,
@@ -106,11 +110,130 @@ struct bb_t
 };
 
 
+struct bb_index_node_t
+{
+    int x1, y1, x2, y2;
+    int first, count; // Range in the level below (or in items, for leaves)
+};
+
+
+// Packed R-tree over a map's bounding boxes. It is rebuilt lazily the next time it's
+// queried after being invalidated. Copies are left empty so undo history doesn't carry it.
+struct bb_index_t
+{
+    bool dirty = true;
+    std::vector<int> items; // bb indices, in leaf order
+    std::vector<int> item_leaf; // Leaf node of each bb
+    std::vector<std::vector<bb_index_node_t>> levels; // [0] are leaves, back() is the root
+
+    bb_index_t() = default;
+    bb_index_t(const bb_index_t&) {}
+    bb_index_t& operator=(const bb_index_t&) { invalidate(); return *this; }
+
+    void invalidate() { dirty = true; }
+    void build(const std::vector<bb_t>& bbs);
+    void moved(const std::vector<bb_t>& bbs, int bb); // Grows the bounds up the tree to fit a box that moved
+    void query(const std::vector<bb_t>& bbs, int x1, int y1, int x2, int y2, std::vector<int>& out); // Sorted bb indices overlapping the area
+};
+
+
+static inline int lowest_bit_index(uint64_t bits)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (int)index;
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+
+// Set of sector indices, one bit per sector. Iterates in ascending order like the std::set it replaces.
+// Erasing the sector an iterator is on is fine, it only looks ahead when incremented.
+struct sector_set_t
+{
+    std::vector<uint64_t> words;
+
+    struct iterator
+    {
+        const sector_set_t* set;
+        int sector;
+
+        int operator*() const { return sector; }
+        bool operator!=(const iterator& other) const { return sector != other.sector; }
+        iterator& operator++() { sector = set->next(sector + 1); return *this; }
+    };
+
+    void resize(int sector_count) // Only ever grows, never drops sectors
+    {
+        size_t word_count = (size_t)(sector_count + 63) / 64;
+        if (word_count > words.size()) words.resize(word_count, 0);
+    }
+    void truncate(int sector_count) // Drops sectors past the end
+    {
+        size_t word_count = (size_t)(sector_count + 63) / 64;
+        if (word_count < words.size()) words.resize(word_count);
+        if (sector_count % 64 && word_count == words.size()) words.back() &= ((uint64_t)1 << (sector_count % 64)) - 1;
+    }
+    void clear() { words.clear(); }
+
+    void insert(int sector)
+    {
+        if (sector < 0) return;
+        if (sector / 64 >= (int)words.size()) words.resize(sector / 64 + 1, 0);
+        words[sector / 64] |= (uint64_t)1 << (sector % 64);
+    }
+
+    void erase(int sector)
+    {
+        if (sector < 0 || sector / 64 >= (int)words.size()) return;
+        words[sector / 64] &= ~((uint64_t)1 << (sector % 64));
+    }
+
+    size_t count(int sector) const
+    {
+        if (sector < 0 || sector / 64 >= (int)words.size()) return 0;
+        return (words[sector / 64] >> (sector % 64)) & 1;
+    }
+
+    // First sector at or after 'from', or -1
+    int next(int from) const
+    {
+        int w = from / 64;
+        if (w >= (int)words.size()) return -1;
+        uint64_t bits = words[w] & (~(uint64_t)0 << (from % 64));
+        while (true)
+        {
+            if (bits) return w * 64 + lowest_bit_index(bits);
+            if (++w >= (int)words.size()) return -1;
+            bits = words[w];
+        }
+    }
+
+    iterator begin() const { return {this, next(0)}; }
+    iterator end() const { return {this, -1}; }
+
+    bool operator==(const sector_set_t& other) const
+    {
+        // Sizes can differ, but only zeros are allowed past the shorter one
+        size_t common = std::min(words.size(), other.words.size());
+        for (size_t i = 0; i < common; ++i)
+            if (words[i] != other.words[i]) return false;
+        for (size_t i = common; i < words.size(); ++i)
+            if (words[i]) return false;
+        for (size_t i = common; i < other.words.size(); ++i)
+            if (other.words[i]) return false;
+        return true;
+    }
+};
+
+
 struct region_t
 {
     std::string name;
-    std::set<int> sectors;
-    Color tint = Color::White;
+    sector_set_t sectors;
+    color_t tint = {1.0f, 1.0f, 1.0f, 1.0f};
     rule_region_t rules;
 
     bool operator==(const region_t& other) const
@@ -145,18 +268,19 @@ struct location_t
 
 struct map_state_t
 {
-    Vector2 pos;
+    vec2_t pos;
     float angle = 0.0f;
     int selected_bb = -1;
     int selected_region = -1;
     int selected_location = -1;
     std::vector<bb_t> bbs;
+    bb_index_t bb_index; // Must be invalidated whenever bbs are added, removed or replaced
     std::vector<region_t> regions;
+    std::vector<int16_t> sector_region; // First region holding each sector, -1 if none. Kept in sync with regions' sectors.
     rule_region_t world_rules;
     rule_region_t exit_rules;
     std::set<int> accesses;
     std::map<int, location_t> locations;
-    bool different = false;
 
     int true_check_count; // Map check count, minus unreachable
     int check_sanity_count; // Number of check_sanity locations
@@ -171,12 +295,17 @@ struct map_state_t
             accesses == other.accesses &&
             locations == other.locations;
     }
+
+    int get_override_bb_at(int x, int y); // First bb with a region containing the point, or -1
+
+    void rebuild_sector_regions(int sector_count);
+    void set_sector_region(int sector, int region); // Moves sector into region, or out of any region if -1
 };
 
 
 struct map_view_t
 {
-    Vector2 cam_pos;
+    vec2_t cam_pos;
     float cam_zoom = 0.25f;
 };
 
@@ -198,9 +327,22 @@ struct meta_t // Bad name, but everything about a level
 
     map_t map; // As loaded from the wad
     map_state_t state; // What we play with
-    map_state_t state_new; // For diffing
+    map_state_t state_new; // For diffing, the last saved version. Decoded from saved_record when shown.
     map_view_t view; // Camera zoom/position
     map_history_t history; // History of map_state_t for undo/redo (It's infinite!)
+
+    int save_version = 0; // Bumped on every change to state
+    int save_fragment_version = -1; // save_version the fragments below were made from
+    std::shared_ptr<const std::string> save_fragment; // This level's part of the .data.json, reused by saves while it's current
+    std::shared_ptr<const std::string> save_bin_fragment; // Same for the .data.bin
+
+    // Hashes of the level's saved data, as hash_level_bin() of its .data.bin record
+    uint64_t state_hash = 0; // Of state, redone on every change
+    uint64_t saved_hash = 0; // Of the version last saved or loaded, 0 if there's none
+    uint64_t state_new_hash = 0; // Of what's in state_new
+    std::shared_ptr<const std::string> saved_record; // The version last saved or loaded, shared with save_bin_fragment
+
+    bool different() const { return state_hash != saved_hash; }
 };
 
 
@@ -221,7 +363,9 @@ struct ap_item_def_t
     int doom_type = -1;
     std::string name;
     std::string sprite;
-    OTextureRef icon;
+    std::vector<uint8_t> icon_pixels; // RGBA, the editor makes a texture out of it
+    int icon_width = 0;
+    int icon_height = 0;
 
     std::vector<std::string> groups;
     int count = 0;
@@ -235,7 +379,59 @@ struct ap_key_def_t
     int key = -1;
     bool use_skull = false; // Only relevent for doom games
     std::string region_name;
-    Color color;
+    color_t color;
+};
+
+
+enum class item_category_t : int8_t
+{
+    none,
+    progression,
+    useful,
+    filler,
+    unique_progression,
+    unique_useful,
+    unique_filler
+};
+
+
+// What a doom type is to a game. Indices are of the first definition with the type, -1 if none.
+struct doom_type_info_t
+{
+    int16_t location = -1; // In doom_type_table_t::location_names, if things of this type are checks
+    item_category_t item_category = item_category_t::none; // First list get_item_name() finds it in
+    int8_t key_slot = -1; // 0 to 2
+    int16_t item = -1; // In the list of its item_category
+    int16_t key = -1; // In keys
+    int16_t unique_progression = -1;
+    int16_t item_requirement = -1;
+    int16_t extra_connection_requirement = -1;
+
+    bool is_location() const { return location != -1; }
+};
+
+
+// Built once the game's items and locations are known, so classifying a thing is an array index
+struct doom_type_table_t
+{
+    std::vector<doom_type_info_t> types; // By doom type, up to the highest one the game defines anything for
+    std::vector<doom_type_info_t> special_types; // By -doom_type, for the negative ones
+    std::vector<std::string> location_names;
+
+    const doom_type_info_t& operator[](int doom_type) const
+    {
+        static const doom_type_info_t none;
+        if (doom_type >= 0)
+            return doom_type < (int)types.size() ? types[doom_type] : none;
+        return -doom_type < (int)special_types.size() ? special_types[-doom_type] : none;
+    }
+
+    const std::string& location_name(int doom_type) const
+    {
+        static const std::string not_a_location;
+        int location = (*this)[doom_type].location;
+        return location != -1 ? location_names[location] : not_a_location;
+    }
 };
 
 
@@ -271,8 +467,9 @@ struct game_t
     std::vector<ap_item_def_t> unique_useful;
     std::vector<ap_item_def_t> unique_filler;
     std::vector<ap_key_def_t> keys;
+    doom_type_table_t doom_types; // Of all the above
 
-    Color key_colors[3];
+    color_t key_colors[3];
     int ep_count = -1;
     std::vector<std::vector<meta_t>> episodes;
     std::vector<episode_info_t> episode_info;
@@ -295,6 +492,12 @@ struct game_t
         int no_exit_connection;
     } warnings;
     bool loaded; // load() was attempted on this world
+    bool data_unreadable = false; // Its .data.json failed to load, so it's not saved over or generated from
+
+    // Edits made since the .data.json with this hash was loaded or saved, for crash recovery
+    FILE* journal = nullptr;
+    uint64_t data_hash = 0;
+    uint64_t data_size = 0;
 };
 
 
@@ -323,11 +526,42 @@ enum class active_source_t
 };
 
 
+enum class catalog_state_t
+{
+    listed,
+    loading,
+    loaded,
+    failed
+};
+
+
+// What's known about a game before it's opened, read from the top of its .game.json
+struct game_catalog_entry_t
+{
+    std::string path;
+    std::string short_name;
+    std::string full_name;
+    std::string iwad_name;
+    std::vector<std::string> required_wads;
+    std::vector<std::string> episode_names;
+    std::vector<std::vector<std::string>> map_names; // Per episode
+    std::string missing_wad; // First wad that couldn't be found, if any
+
+    catalog_state_t state = catalog_state_t::listed;
+    bool generate_when_loaded = false;
+};
+
+
 extern std::map<std::string, game_t> games;
+extern std::map<std::string, game_catalog_entry_t> game_catalog;
 
 
 void init_data();
-void init_worlds(std::vector<std::string> game_json_file, bool summarize = true);
+std::vector<std::string> find_game_jsons(const std::string& folder);
+std::vector<std::string> get_game_files(const game_t* game);
+void catalog_games(const std::vector<std::string>& game_json_files);
+bool init_game(const std::string& game_json_file, game_t& game, std::vector<std::string>& errors,
+    const std::map<std::string, uint64_t>* previous_hashes = nullptr, bool headless = false);
 game_t* get_game(const level_index_t& idx);
 meta_t* get_meta(const level_index_t& idx, active_source_t source = active_source_t::current);
 map_state_t* get_state(const level_index_t& idx, active_source_t source = active_source_t::current);
@@ -0,0 +1,486 @@
+#include "data_bin.h"
+#include "json_writer.hpp"
+
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <filesystem>
+#include <unordered_map>
+
+#if defined(WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+//
+// Encoding
+//
+
+struct data_bin_strings_t
+{
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<const std::string*> strings;
+
+    uint32_t get(const std::string& str)
+    {
+        auto it = ids.find(str);
+        if (it != ids.end()) return it->second;
+        uint32_t id = (uint32_t)strings.size();
+        ids.emplace(str, id);
+        strings.push_back(&str);
+        return id;
+    }
+};
+
+
+template<typename T>
+static void put(std::string& out, const T& value)
+{
+    out.append((const char*)&value, sizeof(T));
+}
+
+
+static void encode_rules(std::string& out, const rule_region_t& rules)
+{
+    put(out, data_bin_rules_t{rules.x, rules.y, (uint32_t)rules.connections.size()});
+    for (const auto& connection : rules.connections)
+    {
+        put(out, data_bin_connection_t{
+            connection.target_region,
+            (uint32_t)connection.requirements_or.size(),
+            (uint32_t)connection.requirements_and.size()
+        });
+        for (int requirement : connection.requirements_or) put(out, (int32_t)requirement);
+        for (int requirement : connection.requirements_and) put(out, (int32_t)requirement);
+    }
+}
+
+
+void encode_data_bin_header(std::string& out, uint64_t json_hash, uint64_t json_size, int level_count)
+{
+    put(out, data_bin_header_t{DATA_BIN_MAGIC, DATA_BIN_VERSION, json_hash, json_size, (uint32_t)level_count, 0});
+}
+
+
+void encode_level_bin(std::string& out, const map_state_t& state, const std::string& lump_name, int ep, int map)
+{
+    size_t start = out.size();
+    data_bin_strings_t strings;
+
+    data_bin_level_t level;
+    level.record_size = 0; // Patched at the end
+    level.lump_name = strings.get(lump_name);
+    level.ep = ep;
+    level.map = map;
+    level.bb_count = (uint32_t)state.bbs.size();
+    level.region_count = (uint32_t)state.regions.size();
+    level.access_count = (uint32_t)state.accesses.size();
+    level.location_count = (uint32_t)state.locations.size();
+    level.string_count = 0; // Patched at the end
+    put(out, level);
+
+    for (const auto& bb : state.bbs)
+        put(out, data_bin_bb_t{bb.x1, bb.y1, bb.x2, bb.y2, bb.region});
+
+    for (const auto& region : state.regions)
+    {
+        data_bin_region_t bin_region;
+        bin_region.name = strings.get(region.name);
+        bin_region.tint[0] = region.tint.r;
+        bin_region.tint[1] = region.tint.g;
+        bin_region.tint[2] = region.tint.b;
+        bin_region.tint[3] = region.tint.a;
+        // Trailing empty words depend on how the set grew, leave them out so equal sets encode the same
+        size_t word_count = region.sectors.words.size();
+        while (word_count > 0 && region.sectors.words[word_count - 1] == 0)
+            --word_count;
+        bin_region.sector_word_count = (uint32_t)word_count;
+        put(out, bin_region);
+        out.append((const char*)region.sectors.words.data(), word_count * sizeof(uint64_t));
+        encode_rules(out, region.rules);
+    }
+
+    for (int access : state.accesses)
+        put(out, (int32_t)access);
+
+    for (const auto& kv : state.locations)
+    {
+        data_bin_location_t location;
+        location.index = kv.first;
+        location.flags =
+            (kv.second.death_logic ? DATA_BIN_LOCATION_DEATH_LOGIC : 0) |
+            (kv.second.unreachable ? DATA_BIN_LOCATION_UNREACHABLE : 0) |
+            (kv.second.check_sanity ? DATA_BIN_LOCATION_CHECK_SANITY : 0);
+        location.name = strings.get(kv.second.name);
+        location.description = strings.get(kv.second.description);
+        put(out, location);
+    }
+
+    encode_rules(out, state.world_rules);
+    encode_rules(out, state.exit_rules);
+
+    // String table
+    uint32_t offset = 0;
+    for (const auto* str : strings.strings)
+    {
+        put(out, offset);
+        offset += (uint32_t)str->size();
+    }
+    put(out, offset);
+    for (const auto* str : strings.strings)
+        out.append(*str);
+    out.append((4 - out.size() % 4) % 4, '\0');
+
+    auto header = (data_bin_level_t*)&out[start];
+    header->record_size = (uint32_t)(out.size() - start);
+    header->string_count = (uint32_t)strings.strings.size();
+}
+
+
+// Leaves out where the level is in its game, which can change when the .game.json is edited
+uint64_t hash_level_bin(const std::string& record)
+{
+    size_t skip_begin = offsetof(data_bin_level_t, ep);
+    size_t skip_end = offsetof(data_bin_level_t, map) + sizeof(int32_t);
+    if (record.size() < skip_end)
+        return hash_bytes(record.data(), record.size());
+    uint64_t hash = hash_bytes(record.data(), skip_begin);
+    return hash_bytes(record.data() + skip_end, record.size() - skip_end, hash);
+}
+
+
+//
+// Decoding
+//
+
+struct data_bin_reader_t
+{
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok = true;
+
+    template<typename T>
+    T get()
+    {
+        T value = {};
+        if (!ok || (size_t)(end - p) < sizeof(T))
+        {
+            ok = false;
+            return value;
+        }
+        memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return value;
+    }
+
+    bool has(size_t count, size_t size)
+    {
+        ok = ok && (size == 0 || count <= (size_t)(end - p) / size);
+        return ok;
+    }
+};
+
+
+static void decode_rules(data_bin_reader_t& reader, rule_region_t& rules)
+{
+    auto bin_rules = reader.get<data_bin_rules_t>();
+    rules.x = bin_rules.x;
+    rules.y = bin_rules.y;
+    if (!reader.has(bin_rules.connection_count, sizeof(data_bin_connection_t))) return;
+    rules.connections.resize(bin_rules.connection_count);
+    for (auto& connection : rules.connections)
+    {
+        auto bin_connection = reader.get<data_bin_connection_t>();
+        connection.target_region = bin_connection.target_region;
+        if (!reader.has((size_t)bin_connection.or_count + bin_connection.and_count, sizeof(int32_t))) return;
+        connection.requirements_or.resize(bin_connection.or_count);
+        for (auto& requirement : connection.requirements_or) requirement = reader.get<int32_t>();
+        connection.requirements_and.resize(bin_connection.and_count);
+        for (auto& requirement : connection.requirements_and) requirement = reader.get<int32_t>();
+    }
+}
+
+
+bool decode_level_bin(const uint8_t* data, size_t size, saved_level_t& level, size_t* record_size)
+{
+    data_bin_reader_t reader = {data, data + size};
+    auto header = reader.get<data_bin_level_t>();
+    if (!reader.ok || header.record_size < sizeof(data_bin_level_t) || header.record_size > size) return false;
+    reader.end = data + header.record_size;
+    if (record_size) *record_size = header.record_size;
+
+    // Strings are at the end, but needed all along
+    std::vector<std::string> strings;
+    {
+        // Walk the body first to find where the table starts
+        data_bin_reader_t body = reader;
+        body.has(header.bb_count, sizeof(data_bin_bb_t));
+        body.p += body.ok ? header.bb_count * sizeof(data_bin_bb_t) : 0;
+        for (uint32_t i = 0; i < header.region_count && body.ok; ++i)
+        {
+            auto bin_region = body.get<data_bin_region_t>();
+            if (!body.has(bin_region.sector_word_count, sizeof(uint64_t))) break;
+            body.p += bin_region.sector_word_count * sizeof(uint64_t);
+            rule_region_t skipped;
+            decode_rules(body, skipped);
+        }
+        if (body.has(header.access_count, sizeof(int32_t))) body.p += header.access_count * sizeof(int32_t);
+        if (body.has(header.location_count, sizeof(data_bin_location_t))) body.p += header.location_count * sizeof(data_bin_location_t);
+        rule_region_t skipped;
+        decode_rules(body, skipped);
+        decode_rules(body, skipped);
+
+        if (!body.has((size_t)header.string_count + 1, sizeof(uint32_t))) return false;
+        std::vector<uint32_t> offsets(header.string_count + 1);
+        for (auto& offset : offsets) offset = body.get<uint32_t>();
+        const char* chars = (const char*)body.p;
+        for (uint32_t i = 0; i < header.string_count; ++i)
+        {
+            if (offsets[i] > offsets[i + 1] || offsets[i + 1] > (size_t)(body.end - body.p)) return false;
+            strings.emplace_back(chars + offsets[i], offsets[i + 1] - offsets[i]);
+        }
+    }
+    auto get_string = [&strings, &reader](uint32_t id) -> std::string
+    {
+        if (id >= strings.size())
+        {
+            reader.ok = false;
+            return {};
+        }
+        return strings[id];
+    };
+
+    level.lump_name = get_string(header.lump_name);
+    level.ep = header.ep;
+    level.map = header.map;
+
+    if (!reader.has(header.bb_count, sizeof(data_bin_bb_t))) return false;
+    level.bbs.resize(header.bb_count);
+    for (auto& bb : level.bbs)
+    {
+        auto bin_bb = reader.get<data_bin_bb_t>();
+        bb = {bin_bb.x1, bin_bb.y1, bin_bb.x2, bin_bb.y2, bin_bb.region};
+    }
+
+    if (!reader.has(header.region_count, sizeof(data_bin_region_t))) return false;
+    level.regions.resize(header.region_count);
+    for (auto& region : level.regions)
+    {
+        auto bin_region = reader.get<data_bin_region_t>();
+        region.name = get_string(bin_region.name);
+        region.tint = color_t(bin_region.tint[0], bin_region.tint[1], bin_region.tint[2], bin_region.tint[3]);
+        if (!reader.has(bin_region.sector_word_count, sizeof(uint64_t))) return false;
+        region.sectors.words.resize(bin_region.sector_word_count);
+        memcpy(region.sectors.words.data(), reader.p, bin_region.sector_word_count * sizeof(uint64_t));
+        reader.p += bin_region.sector_word_count * sizeof(uint64_t);
+        decode_rules(reader, region.rules);
+    }
+
+    if (!reader.has(header.access_count, sizeof(int32_t))) return false;
+    level.accesses.resize(header.access_count);
+    for (auto& access : level.accesses) access = reader.get<int32_t>();
+
+    if (!reader.has(header.location_count, sizeof(data_bin_location_t))) return false;
+    level.locations.resize(header.location_count);
+    for (auto& kv : level.locations)
+    {
+        auto bin_location = reader.get<data_bin_location_t>();
+        kv.first = bin_location.index;
+        kv.second.death_logic = (bin_location.flags & DATA_BIN_LOCATION_DEATH_LOGIC) != 0;
+        kv.second.unreachable = (bin_location.flags & DATA_BIN_LOCATION_UNREACHABLE) != 0;
+        kv.second.check_sanity = (bin_location.flags & DATA_BIN_LOCATION_CHECK_SANITY) != 0;
+        kv.second.name = get_string(bin_location.name);
+        kv.second.description = get_string(bin_location.description);
+    }
+
+    decode_rules(reader, level.world_rules);
+    decode_rules(reader, level.exit_rules);
+
+    return reader.ok;
+}
+
+
+//
+// Files
+//
+
+// Read only view of a whole file
+struct mapped_file_t
+{
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+#if defined(WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+    bool open(const std::string& filename)
+    {
+#if defined(WIN32)
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) return false;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) return false;
+        data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        size = (size_t)file_size.QuadPart;
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // The mapping stays valid
+        if (view == MAP_FAILED) return false;
+        data = (const uint8_t*)view;
+        size = (size_t)st.st_size;
+#endif
+        return data != nullptr;
+    }
+
+    ~mapped_file_t()
+    {
+#if defined(WIN32)
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (data) munmap((void*)data, size);
+#endif
+    }
+};
+
+
+// Fails unless the sidecar was written along with the exact .data.json bytes given
+bool read_data_bin(const std::string& filename, uint64_t json_hash, uint64_t json_size, std::vector<saved_level_t>& levels)
+{
+    mapped_file_t file;
+    if (!file.open(filename)) return false;
+
+    data_bin_reader_t reader = {file.data, file.data + file.size};
+    auto header = reader.get<data_bin_header_t>();
+    if (!reader.ok ||
+        header.magic != DATA_BIN_MAGIC ||
+        header.version != DATA_BIN_VERSION ||
+        header.json_hash != json_hash ||
+        header.json_size != json_size) return false;
+
+    // Every record is at least its header, so a count the file can't hold is garbage
+    if (header.level_count > (size_t)(reader.end - reader.p) / sizeof(data_bin_level_t)) return false;
+
+    levels.clear();
+    levels.resize(header.level_count);
+    for (auto& level : levels)
+    {
+        size_t record_size;
+        if (!decode_level_bin(reader.p, (size_t)(reader.end - reader.p), level, &record_size))
+        {
+            levels.clear();
+            return false;
+        }
+        reader.p += record_size;
+    }
+    return true;
+}
+
+
+// Writes to a temp file next to the destination, then moves it in place once it's on disk
+bool write_file_atomic(const std::string& filename, const std::string& contents)
+{
+    std::string temp_filename = filename + ".tmp";
+    FILE* f = fopen(temp_filename.c_str(), "wb");
+    if (!f) return false;
+
+    bool ok = fwrite(contents.data(), 1, contents.size(), f) == contents.size();
+    ok = fflush(f) == 0 && ok;
+#if defined(WIN32)
+    ok = _commit(_fileno(f)) == 0 && ok;
+#else
+    ok = fsync(fileno(f)) == 0 && ok;
+#endif
+    ok = fclose(f) == 0 && ok;
+
+    std::error_code ec;
+    if (ok)
+    {
+        std::filesystem::rename(temp_filename, filename, ec);
+        ok = !ec;
+    }
+    if (!ok)
+        std::filesystem::remove(temp_filename, ec);
+    return ok;
+}
+
+
+//
+// Journal
+//
+
+// Starts a new, empty journal, replacing any previous one
+FILE* create_journal(const std::string& filename, uint64_t json_hash, uint64_t json_size)
+{
+    FILE* journal = fopen(filename.c_str(), "wb");
+    if (!journal) return nullptr;
+
+    data_journal_header_t header = {DATA_JOURNAL_MAGIC, DATA_JOURNAL_VERSION, json_hash, json_size};
+    if (fwrite(&header, sizeof(header), 1, journal) != 1 || fflush(journal) != 0)
+    {
+        fclose(journal);
+        return nullptr;
+    }
+    return journal;
+}
+
+
+// Flushed right away, so it survives the program crashing
+bool append_journal(FILE* journal, const std::string& record)
+{
+    data_journal_entry_t entry = {(uint32_t)record.size(), 0, hash_bytes(record.data(), record.size())};
+    std::string out((const char*)&entry, sizeof(entry));
+    out += record;
+    return fwrite(out.data(), 1, out.size(), journal) == out.size() && fflush(journal) == 0;
+}
+
+
+// Levels in the order they were journaled, a level can appear more than once. Stops at the
+// first damaged entry, which is the one being written when it crashed.
+bool read_journal(const std::string& filename, uint64_t json_hash, uint64_t json_size, std::vector<saved_level_t>& levels)
+{
+    mapped_file_t file;
+    if (!file.open(filename)) return false;
+
+    data_bin_reader_t reader = {file.data, file.data + file.size};
+    auto header = reader.get<data_journal_header_t>();
+    if (!reader.ok ||
+        header.magic != DATA_JOURNAL_MAGIC ||
+        header.version != DATA_JOURNAL_VERSION ||
+        header.json_hash != json_hash ||
+        header.json_size != json_size) return false;
+
+    levels.clear();
+    while (reader.p < reader.end)
+    {
+        auto entry = reader.get<data_journal_entry_t>();
+        if (!reader.ok || !reader.has(entry.record_size, 1)) break;
+        if (hash_bytes(reader.p, entry.record_size) != entry.record_hash) break;
+
+        saved_level_t level;
+        if (!decode_level_bin(reader.p, entry.record_size, level)) break;
+        levels.push_back(std::move(level));
+        reader.p += entry.record_size;
+    }
+    return true;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <stdio.h>
+
+#include "data.h"
+
+
+#define DATA_BIN_MAGIC 0x42445041 // "APDB"
+#define DATA_BIN_VERSION 1
+#define DATA_JOURNAL_MAGIC 0x4A445041 // "APDJ"
+#define DATA_JOURNAL_VERSION 1
+
+
+// A level as stored in a .data.json or .data.bin, before being applied to its meta_t.
+struct saved_level_t
+{
+    std::string lump_name;
+    int ep = 0;
+    int map = 0;
+    std::vector<bb_t> bbs;
+    std::vector<region_t> regions;
+    std::vector<int> accesses;
+    std::vector<std::pair<int, location_t>> locations; // Thing index, location
+    rule_region_t world_rules;
+    rule_region_t exit_rules;
+};
+
+
+// Binary sidecar of a .data.json, for faster loading. Native byte order, everything 4 byte aligned.
+// The file is a header followed by one record per level. Records are self contained, strings
+// are indices into a table at the end of the record.
+struct data_bin_header_t
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t json_hash; // Hash of the .data.json bytes written along with this
+    uint64_t json_size;
+    uint32_t level_count;
+    uint32_t pad;
+};
+
+struct data_bin_level_t // Followed by bbs, regions, accesses, locations, world rules, exit rules, then strings
+{
+    uint32_t record_size; // Including this header
+    uint32_t lump_name;
+    int32_t ep;
+    int32_t map;
+    uint32_t bb_count;
+    uint32_t region_count;
+    uint32_t access_count;
+    uint32_t location_count;
+    uint32_t string_count; // Table is uint32_t offsets[string_count + 1], then the characters
+};
+
+struct data_bin_bb_t
+{
+    int32_t x1, y1, x2, y2;
+    int32_t region;
+};
+
+struct data_bin_region_t // Followed by its sector bitset words, then its rules
+{
+    uint32_t name;
+    float tint[4];
+    uint32_t sector_word_count;
+};
+
+struct data_bin_rules_t // Followed by its connections
+{
+    int32_t x, y;
+    uint32_t connection_count;
+};
+
+struct data_bin_connection_t // Followed by its OR requirements, then its AND requirements
+{
+    int32_t target_region;
+    uint32_t or_count;
+    uint32_t and_count;
+};
+
+#define DATA_BIN_LOCATION_DEATH_LOGIC   0x1
+#define DATA_BIN_LOCATION_UNREACHABLE   0x2
+#define DATA_BIN_LOCATION_CHECK_SANITY  0x4
+
+struct data_bin_location_t
+{
+    int32_t index;
+    uint32_t flags;
+    uint32_t name;
+    uint32_t description;
+};
+
+
+// Journal of edits made since a .data.json was written. Each entry is the whole level
+// as it was after the edit, in the same record format as the .data.bin.
+struct data_journal_header_t
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t json_hash; // Hash of the .data.json this applies on top of
+    uint64_t json_size;
+};
+
+struct data_journal_entry_t // Followed by a level record
+{
+    uint32_t record_size;
+    uint32_t pad;
+    uint64_t record_hash; // To drop an entry torn by a crash
+};
+
+
+void encode_data_bin_header(std::string& out, uint64_t json_hash, uint64_t json_size, int level_count);
+void encode_level_bin(std::string& out, const map_state_t& state, const std::string& lump_name, int ep, int map);
+uint64_t hash_level_bin(const std::string& record);
+bool decode_level_bin(const uint8_t* data, size_t size, saved_level_t& level, size_t* record_size = nullptr);
+bool read_data_bin(const std::string& filename, uint64_t json_hash, uint64_t json_size, std::vector<saved_level_t>& levels);
+bool write_file_atomic(const std::string& filename, const std::string& contents);
+
+FILE* create_journal(const std::string& filename, uint64_t json_hash, uint64_t json_size);
+bool append_journal(FILE* journal, const std::string& record);
+bool read_journal(const std::string& filename, uint64_t json_hash, uint64_t json_size, std::vector<saved_level_t>& levels);
@@ -0,0 +1,502 @@
+#include "data_load.h"
+#include "maps.h"
+#include "defs.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <set>
+
+#include "json_reader.hpp"
+#include "json_writer.hpp"
+#include "message.hpp"
+#include "util.hpp"
+
+
+// Map sidedefs index sectors with 16 bits, so anything past this in a file is garbage
+#define MAX_SAVED_SECTORS 65536
+
+
+rule_region_t deserialize_rules(JsonPullReader& reader)
+{
+    rule_region_t rules;
+    std::string key;
+
+    if (!reader.BeginObject()) return rules;
+    while (reader.NextKey(key))
+    {
+        if (key == "x") rules.x = reader.GetInt();
+        else if (key == "y") rules.y = reader.GetInt();
+        else if (key == "connections")
+        {
+            if (!reader.BeginArray()) continue;
+            while (reader.NextElement())
+            {
+                rule_connection_t connection;
+
+                if (reader.BeginObject())
+                {
+                    while (reader.NextKey(key))
+                    {
+                        if (key == "target_region") connection.target_region = reader.GetInt(-1);
+                        else if (key == "requirements_or")
+                        {
+                            if (!reader.BeginArray()) continue;
+                            while (reader.NextElement())
+                                connection.requirements_or.push_back(reader.GetInt());
+                        }
+                        else if (key == "requirements_and")
+                        {
+                            if (!reader.BeginArray()) continue;
+                            while (reader.NextElement())
+                                connection.requirements_and.push_back(reader.GetInt());
+                        }
+                        else reader.Skip();
+                    }
+                }
+
+                rules.connections.push_back(connection);
+            }
+        }
+        else reader.Skip();
+    }
+
+    return rules;
+}
+
+
+std::string rehash_level(game_t* game, int ep, int lvl)
+{
+    auto& meta = game->episodes[ep][lvl];
+    std::string record;
+    encode_level_bin(record, meta.state, meta.lump_name, ep, lvl);
+    meta.state_hash = hash_level_bin(record);
+    return record;
+}
+
+
+// Whatever every level is now is what's on disk
+static void mark_levels_saved(game_t* game)
+{
+    for (int ep = 0; ep < (int)game->episodes.size(); ++ep)
+    {
+        for (int lvl = 0; lvl < (int)game->episodes[ep].size(); ++lvl)
+        {
+            auto& meta = game->episodes[ep][lvl];
+            meta.saved_record = std::make_shared<const std::string>(rehash_level(game, ep, lvl));
+            meta.saved_hash = meta.state_hash;
+        }
+    }
+}
+
+
+void journal_level(game_t* game, int ep, int lvl, const std::string* record)
+{
+    std::string journal_filename = "data/" + game->short_name + ".journal";
+    if (!game->journal)
+    {
+        game->journal = create_journal(journal_filename, game->data_hash, game->data_size);
+        if (!game->journal)
+        {
+            OnScreenMessages::AddWarning("WARNING: Can't open '" + journal_filename + "', changes are only kept by saving.");
+            return;
+        }
+    }
+
+    std::string encoded;
+    if (!record)
+    {
+        const auto& meta = game->episodes[ep][lvl];
+        encode_level_bin(encoded, meta.state, meta.lump_name, ep, lvl);
+        record = &encoded;
+    }
+    if (!append_journal(game->journal, *record))
+        OnScreenMessages::AddWarning("WARNING: Failed to write '" + journal_filename + "'.");
+}
+
+
+// Members come in whatever order the file has them, so the level they're for (its "_lump")
+// may only be known at the end. That's why this fills a saved_level_t instead of the level's
+// map_state_t, which apply_saved_state() then moves in. It's the same form the .data.bin and
+// journal decode to. The cost is one extra pass over every level on load: most of it is moved,
+// but the accesses are copied into their set.
+saved_level_t deserialize_level(JsonPullReader& reader)
+{
+    saved_level_t level;
+    level.lump_name = "INVALIDNAME";
+    level.ep = -1; // Only in version 1, as a fallback for the lump name
+    level.map = -1;
+    std::string key;
+
+    if (!reader.BeginObject()) return level;
+    while (reader.NextKey(key))
+    {
+        if (key == "_lump") level.lump_name = reader.GetString("INVALIDNAME");
+        else if (key == "ep") level.ep = reader.GetInt();
+        else if (key == "map") level.map = reader.GetInt();
+        else if (key == "world_rules") level.world_rules = deserialize_rules(reader);
+        else if (key == "exit_rules") level.exit_rules = deserialize_rules(reader);
+        else if (key == "bbs")
+        {
+            if (!reader.BeginArray()) continue;
+            while (reader.NextElement())
+            {
+                int coords[5] = {0, 0, 0, 0, -1};
+                int count = 0;
+                if (reader.BeginArray())
+                {
+                    while (reader.NextElement())
+                    {
+                        int value = reader.GetInt();
+                        if (count < 5) coords[count++] = value;
+                    }
+                }
+                level.bbs.push_back({coords[0], coords[1], coords[2], coords[3], coords[4]});
+            }
+        }
+        else if (key == "regions")
+        {
+            if (!reader.BeginArray()) continue;
+            while (reader.NextElement())
+            {
+                region_t region;
+                region.name = "BAD_NAME";
+
+                if (reader.BeginObject())
+                {
+                    while (reader.NextKey(key))
+                    {
+                        if (key == "name") region.name = reader.GetString("BAD_NAME");
+                        else if (key == "rules") region.rules = deserialize_rules(reader);
+                        else if (key == "tint")
+                        {
+                            if (!reader.BeginArray()) continue;
+                            float* tint = &region.tint.r;
+                            int count = 0;
+                            while (reader.NextElement())
+                            {
+                                float value = (float)reader.GetDouble();
+                                if (count < 4) tint[count++] = value;
+                            }
+                        }
+                        else if (key == "sectors")
+                        {
+                            if (!reader.BeginArray()) continue;
+                            while (reader.NextElement())
+                            {
+                                int sectori = reader.GetInt();
+                                if (sectori < 0 || sectori >= MAX_SAVED_SECTORS) continue;
+                                region.sectors.resize(sectori + 1);
+                                region.sectors.insert(sectori);
+                            }
+                        }
+                        else if (key == "sector_ranges")
+                        {
+                            if (!reader.BeginArray()) continue;
+                            while (reader.NextElement())
+                            {
+                                int first = reader.GetInt();
+                                if (!reader.NextElement())
+                                    break; // Odd count, and the array just ended. The half range is dropped.
+                                int last = std::min(reader.GetInt(), MAX_SAVED_SECTORS - 1);
+                                if (first < 0 || last < first) continue;
+                                region.sectors.resize(last + 1);
+                                for (int sectori = first; sectori <= last; ++sectori)
+                                    region.sectors.insert(sectori);
+                            }
+                        }
+                        else reader.Skip();
+                    }
+                }
+
+                level.regions.push_back(std::move(region));
+            }
+        }
+        else if (key == "accesses")
+        {
+            if (!reader.BeginArray()) continue;
+            while (reader.NextElement())
+                level.accesses.push_back(reader.GetInt());
+        }
+        else if (key == "locations")
+        {
+            if (!reader.BeginArray()) continue;
+            while (reader.NextElement())
+            {
+                location_t location;
+                int index = 0;
+
+                if (reader.BeginObject())
+                {
+                    while (reader.NextKey(key))
+                    {
+                        if (key == "index") index = reader.GetInt();
+                        else if (key == "death_logic") location.death_logic = reader.GetBool();
+                        else if (key == "unreachable") location.unreachable = reader.GetBool();
+                        else if (key == "check_sanity") location.check_sanity = reader.GetBool();
+                        else if (key == "name") location.name = reader.GetString();
+                        else if (key == "description") location.description = reader.GetString();
+                        else reader.Skip();
+                    }
+                }
+
+                level.locations.push_back({index, std::move(location)});
+            }
+        }
+        else reader.Skip();
+    }
+
+    return level;
+}
+
+
+// Streams through the file, no Json::Value tree is built
+static bool parse_data_json(const std::vector<uint8_t>& data, std::vector<saved_level_t>& levels, int& version)
+{
+    JsonPullReader reader((const char*)data.data(), data.size());
+    std::string key;
+
+    version = 1;
+    if (!reader.BeginObject()) return false;
+    while (reader.NextKey(key))
+    {
+        if (key == "_version") version = reader.GetInt(1);
+        else if (key == "maps")
+        {
+            if (!reader.BeginArray()) continue;
+            while (reader.NextElement())
+                levels.push_back(deserialize_level(reader));
+        }
+        else reader.Skip();
+    }
+
+    return !reader.Failed() && reader.AtEnd();
+}
+
+
+// Lump name: <game, ep, map>
+// We prefer using lump name to canonically refer to a saved map's data,
+// because otherwise moving maps around between episodes gets messy.
+static std::map<std::string, level_index_t> get_lumpname_to_index(game_t* game)
+{
+    std::map<std::string, level_index_t> lumpname_to_index;
+    for (int ep = 0; ep < game->episodes.size(); ++ep)
+        for (int lvl = 0; lvl < game->episodes[ep].size(); ++lvl)
+            lumpname_to_index.emplace(game->episodes[ep][lvl].lump_name, level_index_t{game->short_name, ep, lvl});
+    return lumpname_to_index;
+}
+
+
+static meta_t* get_saved_level_meta(game_t* game, const std::map<std::string, level_index_t>& lumpname_to_index, const saved_level_t& level)
+{
+    auto it = lumpname_to_index.find(level.lump_name);
+    if (it != lumpname_to_index.end())
+        return get_meta(it->second);
+    else // Fallback to using ep/map from before
+        return get_meta({game->short_name, level.ep, level.map});
+}
+
+
+void apply_saved_state(game_t* game, const map_t* map, map_state_t* _map_state, saved_level_t& level)
+{
+    int sector_count = (int)map->sectors.size();
+
+    if (_map_state->bbs.empty())
+        _map_state->bbs = std::move(level.bbs);
+    else
+        _map_state->bbs.insert(_map_state->bbs.end(), level.bbs.begin(), level.bbs.end());
+    _map_state->bb_index.invalidate();
+
+    for (auto& region : level.regions)
+    {
+        // Saved for a different version of the map, maybe
+        region.sectors.truncate(sector_count);
+        region.sectors.resize(sector_count);
+        _map_state->regions.push_back(std::move(region));
+    }
+    _map_state->rebuild_sector_regions(sector_count);
+
+    _map_state->accesses.insert(level.accesses.begin(), level.accesses.end());
+
+    // Default locations from maps, with the saved ones in place. Both are walked in index
+    // order so every location is inserted once, at the end of the map.
+    std::stable_sort(level.locations.begin(), level.locations.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    auto saved = level.locations.begin();
+    for (int i = 0; i < (int)map->things.size(); ++i)
+    {
+        location_t* location = nullptr;
+        while (saved != level.locations.end() && saved->first <= i)
+        {
+            if (saved->first == i) location = &saved->second; // Last one wins, like before
+            ++saved;
+        }
+
+        const auto& thing = map->things[i];
+        if (thing.flags & THING_FLAG_MP_ONLY) continue; // Thing is not in single player
+        if (game->doom_types[thing.type].is_location())
+        {
+            if (location && location->check_sanity) _map_state->check_sanity_count++;
+            _map_state->locations.emplace_hint(_map_state->locations.end(), i, location ? std::move(*location) : location_t());
+        }
+    }
+
+    _map_state->world_rules = std::move(level.world_rules);
+    _map_state->exit_rules = std::move(level.exit_rules);
+}
+
+
+void apply_saved_level(game_t* game, meta_t* meta, saved_level_t& level)
+{
+    auto map = &meta->map;
+    apply_saved_state(game, map, &meta->state, level);
+    meta->view.cam_pos = vec2_t((float)(map->bb[2] + map->bb[0]) / 2, -(float)(map->bb[3] + map->bb[1]) / 2);
+}
+
+
+// Brings back edits that never made it into a save, if the journal was
+// written on top of the .data.json that was just loaded.
+static void replay_journal(game_t* game)
+{
+    std::string journal_filename = "data/" + game->short_name + ".journal";
+    std::vector<saved_level_t> levels;
+    if (!read_journal(journal_filename, game->data_hash, game->data_size, levels) || levels.empty())
+        return;
+
+    auto lumpname_to_index = get_lumpname_to_index(game);
+    std::set<meta_t*> recovered;
+    for (auto& level : levels)
+    {
+        auto meta = get_saved_level_meta(game, lumpname_to_index, level);
+        if (!meta)
+            continue;
+        meta->state = map_state_t();
+        apply_saved_level(game, meta, level);
+        meta->save_version++;
+        recovered.insert(meta);
+    }
+
+    // Start over with just the latest state of each level
+    if (game->journal)
+        fclose(game->journal);
+    game->journal = nullptr;
+    for (int ep = 0; ep < (int)game->episodes.size(); ++ep)
+    {
+        for (int lvl = 0; lvl < (int)game->episodes[ep].size(); ++lvl)
+        {
+            if (recovered.count(&game->episodes[ep][lvl]))
+            {
+                auto record = rehash_level(game, ep, lvl);
+                journal_level(game, ep, lvl, &record);
+            }
+        }
+    }
+
+    OnScreenMessages::AddWarning("Recovered unsaved changes to " + std::to_string(recovered.size()) + " level(s) from '" + journal_filename + "'.");
+}
+
+
+// The .data.json is the source of truth. The .data.bin next to it is used instead when
+// it was written along with these exact json bytes.
+bool load(game_t* game, bool recover_journal)
+{
+    game->loaded = true;
+    game->data_unreadable = false;
+    for (auto& episode : game->episodes)
+        for (auto& meta : episode)
+        {
+            meta.save_fragment_version = -1;
+            meta.save_fragment.reset();
+            meta.save_bin_fragment.reset();
+        }
+
+    std::string filename = "data/" + game->short_name + ".data.json";
+    std::string bin_filename = "data/" + game->short_name + ".data.bin";
+    auto json_data = read_file_data(filename);
+    game->data_hash = hash_bytes(json_data.data(), json_data.size());
+    game->data_size = json_data.size();
+    if (json_data.empty())
+    {
+        OnScreenMessages::AddWarning("WARNING: " + filename + " not found.\n(If you just created this game, then it's fine. Otherwise, scream.)");
+
+        // Initialize level's Hub and Exit "regions" to reasonable places
+        for (int ep = 0; ep < game->episodes.size(); ++ep)
+        {
+            for (int lvl = 0; lvl < game->episodes[ep].size(); ++lvl)
+            {
+                first_init_level(game, ep, lvl);
+
+                // Nothing is saved yet
+                rehash_level(game, ep, lvl);
+                game->episodes[ep][lvl].saved_record.reset();
+                game->episodes[ep][lvl].saved_hash = 0;
+            }
+        }
+
+        if (recover_journal)
+            replay_journal(game);
+        return true;
+    }
+
+    std::vector<saved_level_t> levels;
+    bool from_bin = false;
+    {
+        std::error_code ec_json, ec_bin;
+        auto json_time = std::filesystem::last_write_time(filename, ec_json);
+        auto bin_time = std::filesystem::last_write_time(bin_filename, ec_bin);
+        if (!ec_json && !ec_bin && bin_time >= json_time)
+            from_bin = read_data_bin(bin_filename, game->data_hash, game->data_size, levels);
+    }
+    if (!from_bin)
+    {
+        levels.clear();
+        int version;
+        if (!parse_data_json(json_data, levels, version))
+        {
+            OnScreenMessages::AddError("Failed to parse '" + filename + "'. It won't be saved over until it loads.");
+            game->data_unreadable = true;
+            return false;
+        }
+        if (version > DATA_JSON_VERSION)
+        {
+            OnScreenMessages::AddError("'" + filename + "' was saved by a newer version of the tool. It won't be saved over.");
+            game->data_unreadable = true;
+            return false;
+        }
+    }
+
+    auto lumpname_to_index = get_lumpname_to_index(game);
+    for (auto& level : levels)
+    {
+        auto meta = get_saved_level_meta(game, lumpname_to_index, level);
+        if (meta)
+            apply_saved_level(game, meta, level);
+    }
+
+    mark_levels_saved(game);
+    if (recover_journal)
+        replay_journal(game);
+    return true;
+}
+
+
+void first_init_level(game_t* game, int ep, int lvl)
+{
+    auto state = get_state({game->short_name, ep, lvl});
+    auto map = get_map({game->short_name, ep, lvl});
+
+    state->bbs.clear();
+    state->bb_index.invalidate();
+    state->selected_bb = -1;
+    state->selected_region = -1;
+    state->selected_location = -1;
+    state->accesses.clear();
+    state->regions.clear();
+    state->rebuild_sector_regions((int)map->sectors.size());
+
+    int rules_x = (int)map->bb[0] - RULES_W * 2;
+    int rules_y = (int)map->bb[1] + ((int)map->bb[3] - (int)map->bb[1]) / 2;
+    state->exit_rules.x = rules_x;
+    state->exit_rules.y = rules_y + RULES_H;
+    state->world_rules.x = rules_x;
+    state->world_rules.y = rules_y - RULES_H;
+}
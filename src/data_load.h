@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+
+#include "data.h"
+#include "data_bin.h"
+
+
+#define DATA_JSON_VERSION 2 // Of the .data.json written by save(). Version 1 had no "_version".
+
+// Where a new level's Hub and Exit rules go, left of the map
+#define RULES_W 1024
+#define RULES_H 400
+
+
+// Reading a game's .data.json (or .data.bin) and journal on top of its maps.
+// Nothing in here needs a window, the command line tool uses it as is.
+// The journal belongs to the editor: only it replays it, which also starts it over.
+// Others load what was last saved and leave the journal alone.
+bool load(game_t* game, bool recover_journal = true);
+void first_init_level(game_t* game, int ep, int lvl);
+
+void apply_saved_state(game_t* game, const map_t* map, map_state_t* map_state, saved_level_t& level);
+void apply_saved_level(game_t* game, meta_t* meta, saved_level_t& level);
+
+// Redoes meta.state_hash, returning the record it was computed from
+std::string rehash_level(game_t* game, int ep, int lvl);
+
+// Appends the level as it is now to the game's journal, which is started on first use.
+// 'record' is the level already encoded, if the caller has it.
+void journal_level(game_t* game, int ep, int lvl, const std::string* record = nullptr);
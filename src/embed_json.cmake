@@ -0,0 +1,28 @@
+# Writes the files in INPUTS ('|' separated) to OUTPUT as byte arrays, declared in embedded_json.h.
+# Usage: cmake -DOUTPUT=<file.cpp> -DINPUTS=<file|file...> -P embed_json.cmake
+
+string(REPLACE "|" ";" INPUTS "${INPUTS}")
+
+# 16 bytes per line (no {n} in cmake regexes)
+set(line_pattern "")
+foreach(i RANGE 1 16)
+    string(APPEND line_pattern "0x..,")
+endforeach()
+
+set(content "// Generated by embed_json.cmake from assets/json, don't edit\n#include <stddef.h>\n")
+foreach(input ${INPUTS})
+    get_filename_component(name "${input}" NAME)
+    string(MAKE_C_IDENTIFIER "embedded_${name}" symbol)
+
+    file(READ "${input}" hex HEX)
+    string(LENGTH "${hex}" hex_length)
+    math(EXPR size "${hex_length} / 2")
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+    string(REGEX REPLACE "(${line_pattern})" "\\1\n" bytes "${bytes}")
+
+    # Null terminated, not counted in the size
+    string(APPEND content "\nextern const unsigned char ${symbol}[] = {\n${bytes}0x00\n};\n")
+    string(APPEND content "extern const size_t ${symbol}_size = ${size};\n")
+endforeach()
+
+file(WRITE "${OUTPUT}" "${content}")
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stddef.h>
+
+// assets/json files built into the executable, see embed_json.cmake
+extern const unsigned char embedded_default_game_info_json[];
+extern const size_t embedded_default_game_info_json_size;
+extern const unsigned char embedded_default_world_info_json[];
+extern const size_t embedded_default_world_info_json_size;
+extern const unsigned char embedded_default_items_json[];
+extern const size_t embedded_default_items_json_size;
+extern const unsigned char embedded_default_locations_json[];
+extern const size_t embedded_default_locations_json_size;
@@ -22,12 +22,10 @@
 #include <string>
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <fstream>
-#include <onut/onut.h>
-#include <onut/Files.h>
-#include <onut/Json.h>
-#include <onut/Strings.h>
-#include <onut/Log.h>
+#include <json/json.h>
 
 #ifndef _WIN32
 #include <sys/stat.h>
@@ -39,10 +37,14 @@
 #include "defs.h"
 
 #include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <thread>
 
 #include "message.hpp"
 #include "python.hpp"
 #include "zip.hpp"
+#include "util.hpp"
 
 
 #define DOOM_TYPE_LEVEL_UNLOCK   -1
@@ -104,20 +106,36 @@ struct level_t
     std::vector<ap_sector_t> sectors;
     bool keys[3] = {false};
     int location_count = 0;
+    std::vector<int64_t> thing_locations; // Location id by thing index, -1 for things that aren't one
     bool use_skull[3] = {false};
     map_t* map = nullptr;
     map_state_t* map_state = nullptr;
 };
 
-static GroupedOutput *world = nullptr;
-
-std::vector<ap_item_t> ap_items;
-std::vector<ap_location_t> ap_locations;
-std::map<std::string, std::set<std::string>> item_name_groups;
-std::map<uintptr_t, std::map<int, int64_t>> level_to_keycards;
-std::map<std::string, ap_item_t*> item_map;
-
-static bool use_extended_names = false; // gross hack, but whatever
+// Everything one generation works on. Nothing in here is shared with another generation,
+// so several games can be generated at once.
+struct generation_context_t
+{
+    game_t* game = nullptr;
+    GroupedOutput *world = nullptr;
+    bool use_extended_names = false;
+
+    std::vector<ap_item_t> ap_items;
+    std::vector<ap_location_t> ap_locations;
+    std::map<std::string, std::set<std::string>> item_name_groups;
+    std::map<uintptr_t, std::map<int, int64_t>> level_to_keycards;
+    std::vector<WorldOption*> world_options;
+
+    // Names given out so far, so finding a free one doesn't rescan every location or item
+    std::unordered_set<std::string> location_names;
+    std::unordered_map<std::string, int> location_name_counts; // Count last given out, by name and extended name
+    std::unordered_map<std::string, int64_t> item_ids_by_name; // Of the first item added with the name
+
+    // Shown once the generation is done, since it may not be on the main thread
+    std::vector<std::string> errors;
+    std::vector<std::string> warnings;
+    std::vector<std::string> notices;
+};
 
 const char* get_doom_type_name(int doom_type);
 
@@ -146,17 +164,15 @@ static std::string get_group_name(meta_t& metamap)
 
 static std::string get_requirement_name(game_t* game, const std::string& level_name, int doom_type)
 {
-    for (const auto& item : game->unique_progression)
-        if (item.doom_type == doom_type)
-            return level_name + " - " + item.name;
+    const auto& type_info = game->doom_types[doom_type];
+    if (type_info.unique_progression != -1)
+        return level_name + " - " + game->unique_progression[type_info.unique_progression].name;
 
-    for (const auto& item : game->keys)
-        if (item.item.doom_type == doom_type)
-            return level_name + " - " + item.item.name;
+    if (type_info.key != -1)
+        return level_name + " - " + game->keys[type_info.key].item.name;
 
-    for (const auto& requirement : game->item_requirements)
-        if (requirement.doom_type == doom_type)
-            return requirement.name;
+    if (type_info.item_requirement != -1)
+        return game->item_requirements[type_info.item_requirement].name;
 
     return "ERROR";
 }
@@ -164,31 +180,22 @@ static std::string get_requirement_name(game_t* game, const std::string& level_n
 // For option-based requirements that cause a connection to get entirely removed if not true
 static std::string get_extra_requirement_name(game_t* game, int doom_type)
 {
-    for (const auto& requirement : game->extra_connection_requirements)
-        if (requirement.doom_type == doom_type)
-            return requirement.name;
+    int requirement = game->doom_types[doom_type].extra_connection_requirement;
+    if (requirement != -1)
+        return game->extra_connection_requirements[requirement].name;
 
     return "ERROR";
 }
 
 
-bool loc_name_taken(const std::string& name)
-{
-    for (const auto& loc : ap_locations)
-    {
-        if (loc.name == name) return true;
-    }
-    return false;
-}
-
-void add_loc(const std::string& name, const map_thing_t& thing, level_t* level, int index, int id)
+void add_loc(generation_context_t& ctx, const std::string& name, const map_thing_t& thing, level_t* level, int index, int id)
 {
     location_t *loc_state = &level->map_state->locations[index];
     // Make sure it's not unreachable
     if (loc_state->unreachable) return;
     if (id > 999)
     {
-        OLogE("Maximum number of locations reached for Episode "
+        log_error("Maximum number of locations reached for Episode "
             + std::to_string(level->idx.ep + 1)
             + " Map "
             + std::to_string(level->idx.map + 1)
@@ -196,22 +203,20 @@ void add_loc(const std::string& name, const map_thing_t& thing, level_t* level,
         return;
     }        
 
-    int count = 0;
-
-    std::string extended_name = loc_state->name;
-
-    std::string loc_name = name;
-    if (use_extended_names && extended_name.length() > 0)
-        loc_name = name + " (" + extended_name + ")";
-
-    while (loc_name_taken(loc_name))
+    std::string extended_name = ctx.use_extended_names ? loc_state->name : "";
+    auto numbered_name = [&](int count)
     {
-        ++count;
-        if (use_extended_names && extended_name.length() > 0)
-            loc_name = name + " " + std::to_string(count + 1) + " (" + extended_name + ")";
-        else
-            loc_name = name + " " + std::to_string(count + 1);
-    }
+        std::string loc_name = (count > 0) ? name + " " + std::to_string(count + 1) : name;
+        if (extended_name.length() > 0)
+            loc_name += " (" + extended_name + ")";
+        return loc_name;
+    };
+
+    // Names only ever get taken, so every count below the last one given out still is
+    int& count = ctx.location_name_counts[name + '\0' + extended_name];
+    std::string loc_name = numbered_name(count);
+    while (!ctx.location_names.insert(loc_name).second)
+        loc_name = numbered_name(++count);
 
     ap_location_t loc;
     loc.name = loc_name;
@@ -223,12 +228,13 @@ void add_loc(const std::string& name, const map_thing_t& thing, level_t* level,
     loc.y = thing.y << 16;
     loc.check_sanity = loc_state->check_sanity;
     loc.loc_state = loc_state;
-    ap_locations.push_back(loc);
+    ctx.ap_locations.push_back(loc);
 
+    level->thing_locations[index] = loc.id;
     level->location_count++;
 }
 
-void add_item_name_groups(const std::string name, const std::vector<std::string> groups, level_t *level = nullptr)
+void add_item_name_groups(generation_context_t& ctx, const std::string name, const std::vector<std::string> groups, level_t *level = nullptr)
 {
     std::string replacement = (level) ? level->group_name : "NULL";
     constexpr std::string_view map_str{"%MAP%"};
@@ -242,19 +248,17 @@ void add_item_name_groups(const std::string name, const std::vector<std::string>
 
         if (map_marker != std::string::npos)
             new_group.replace(map_marker, map_str.size(), replacement);
-        item_name_groups[new_group].insert(name);
+        ctx.item_name_groups[new_group].insert(name);
     }
 }
 
-int64_t add_unique(const ap_key_def_t &key_def, item_classification_t classification, const map_thing_t& thing, level_t* level, int index)
+int64_t add_unique(generation_context_t& ctx, const ap_key_def_t &key_def, item_classification_t classification, const map_thing_t& thing, level_t* level, int index)
 {
     std::string name = level->name + std::string(" - ") + key_def.item.name;
 
-    for (const auto& other_item : ap_items)
-    {
-        if (other_item.name == name)
-            return other_item.id;
-    }
+    auto other_item = ctx.item_ids_by_name.find(name);
+    if (other_item != ctx.item_ids_by_name.end())
+        return other_item->second;
 
     ap_item_t item;
     item.is_key = true;
@@ -266,12 +270,13 @@ int64_t add_unique(const ap_key_def_t &key_def, item_classification_t classifica
     item.doom_type = key_def.item.doom_type;
     item.id = get_item_id_base(item.idx) + item.doom_type;
 
-    add_item_name_groups(name, key_def.item.groups, level);
-    ap_items.push_back(item);
+    add_item_name_groups(ctx, name, key_def.item.groups, level);
+    ctx.item_ids_by_name.emplace(name, item.id);
+    ctx.ap_items.push_back(item);
     return item.id;
 }
 
-ap_item_t& add_item(const ap_item_def_t &item_def, item_classification_t classification, level_t* level = nullptr)
+ap_item_t& add_item(generation_context_t& ctx, const ap_item_def_t &item_def, item_classification_t classification, level_t* level = nullptr)
 {
     ap_item_t item;
     item.is_key = false;
@@ -284,7 +289,7 @@ ap_item_t& add_item(const ap_item_def_t &item_def, item_classification_t classif
     {
     case DOOM_TYPE_LEVEL_UNLOCK:   base_item_id = 0;     break;
     case DOOM_TYPE_LEVEL_COMPLETE: base_item_id = 99999; break;
-    default: OLogE("Unknown special doom_type " + std::to_string(item.doom_type)); break;
+    default: log_error("Unknown special doom_type " + std::to_string(item.doom_type)); break;
     }
 
     if (level)
@@ -302,9 +307,10 @@ ap_item_t& add_item(const ap_item_def_t &item_def, item_classification_t classif
         item.id = base_item_id;
     }
 
-    add_item_name_groups(item.name, item_def.groups, level);
-    ap_items.push_back(item);
-    return ap_items.back();
+    add_item_name_groups(ctx, item.name, item_def.groups, level);
+    ctx.item_ids_by_name.emplace(item.name, item.id);
+    ctx.ap_items.push_back(item);
+    return ctx.ap_items.back();
 }
 
 
@@ -374,14 +380,21 @@ Json::Value make_connection(game_t *game, const rule_connection_t& connection,
 
 // --------------
 
-Json::Value generate_apworld_manifest(game_t *game, const Json::Value &apdoom_json)
+Json::Value generate_apworld_manifest(generation_context_t& ctx, const Json::Value &apdoom_json)
 {
-    static char buf[9];
+    game_t *game = ctx.game;
+    char buf[9];
     time_t dt = time(NULL);
-    strftime(buf, sizeof(buf), "%Y%m%d", localtime(&dt));
+    struct tm local_dt;
+#ifdef _WIN32
+    localtime_s(&local_dt, &dt);
+#else
+    localtime_r(&dt, &local_dt);
+#endif
+    strftime(buf, sizeof(buf), "%Y%m%d", &local_dt);
 
     Json::Value json;
-    if (world->include_manifest_version)
+    if (ctx.world->include_manifest_version)
     {
         json["version"] = 7;
         json["compatible_version"] = 7;        
@@ -403,12 +416,13 @@ Json::Value generate_apworld_manifest(game_t *game, const Json::Value &apdoom_js
     return json;
 }
 
-Json::Value generate_game_defs_json(game_t *game, level_map_t& levels_map)
+Json::Value generate_game_defs_json(generation_context_t& ctx, level_map_t& levels_map)
 {
+    game_t *game = ctx.game;
     Json::Value defs_json;
 
     { // Output location table
-        for (const auto& loc : ap_locations)
+        for (const auto& loc : ctx.ap_locations)
         {
             const std::string& episode = std::to_string(loc.idx.ep + 1);
             const std::string& map = std::to_string(loc.idx.map + 1);
@@ -418,7 +432,7 @@ Json::Value generate_game_defs_json(game_t *game, level_map_t& levels_map)
     }
 
     { // Output item table
-        for (const auto& item : ap_items)
+        for (const auto& item : ctx.ap_items)
         {
             const std::string& item_id = std::to_string(item.id);
             defs_json["item_table"][item_id][0] = item.name;
@@ -460,22 +474,16 @@ Json::Value generate_game_defs_json(game_t *game, level_map_t& levels_map)
             json_level["game_map"][1] = std::atoi(lump_name + 3);
 
             Json::Value json_mts;
-            int idx = 0;
-            for (const auto& thing : level->map->things)
+            for (int idx = 0, len = (int)level->map->things.size(); idx < len; ++idx)
             {
-                for (const auto& loc : ap_locations)
+                const auto& thing = level->map->things[idx];
+                if (level->thing_locations[idx] != -1)
                 {
-                    if (loc.idx == level->idx && loc.doom_thing_index == idx)
-                    {
-                        json_mts[idx][0] = thing.type;
-                        json_mts[idx][1] = loc.id;
-                        break;
-                    }
+                    json_mts[idx][0] = thing.type;
+                    json_mts[idx][1] = level->thing_locations[idx];
                 }
-                if (json_mts[idx].isNull())
+                else
                     json_mts[idx] = thing.type;
-
-                ++idx;
             }
             json_level["thing_list"] = json_mts;
 
@@ -545,66 +553,71 @@ Json::Value generate_game_defs_json(game_t *game, level_map_t& levels_map)
 
 // This is a mess. Many refactors. Sorry...
 // This function is bulky... I've tried to split it up where I can, but there's still a lot. -KS
-int generate(game_t* game)
+static int generate_world(generation_context_t& ctx)
 {
-    OLog("AP Gen Tool version " APGENTOOL_VERSION);
+    log_info("AP Gen Tool version " APGENTOOL_VERSION);
+    game_t* game = ctx.game;
     long runtime_start = get_runtime_us();
     bool is_world_folder = true;
 
-    world = nullptr;
+    if (game->data_unreadable)
+    {
+        ctx.errors.push_back("Not generating '" + game->full_name + "', its .data.json couldn't be loaded.");
+        return 1;
+    }
 
-    for (int i = 0; i < (int)OArguments.size(); ++i)
+    for (int i = 0; i < (int)core_arguments.size(); ++i)
     {
-        if (OArguments[i] == "--world-folder")
+        if (core_arguments[i] == "--world-folder")
         {
             try
             {
-                if (i + 1 >= (int)OArguments.size())
+                if (i + 1 >= (int)core_arguments.size())
                     throw std::runtime_error("Requires an argument.");
-                world = new OutputToFolder(OArguments[i+1], game->ap_world_name);
+                ctx.world = new OutputToFolder(core_arguments[i+1], game->ap_world_name);
             }
             catch (const std::runtime_error& e)
             {
                 std::string error_str = std::string("--world-folder: ") + e.what();
-                OLogE(error_str);
-                OnScreenMessages::AddError(error_str);
+                log_error(error_str);
+                ctx.errors.push_back(error_str);
                 return 1;
             }
             break;
         }
     }
 
-    if (!world)
+    if (!ctx.world)
     {
-        onut::createFolder("output");
-        world = new ZipFile("./output/" + game->ap_world_name + ".apworld");
+        std::string output_folder = "./output";
+        for (int i = 0; i + 1 < (int)core_arguments.size(); ++i)
+        {
+            if (core_arguments[i] == "--output")
+                output_folder = core_arguments[i + 1];
+        }
+        create_folder(output_folder);
+        ctx.world = new ZipFile(output_folder + "/" + game->ap_world_name + ".apworld");
         is_world_folder = false;
     }
 
     // ========================================================================
 
-    ap_items.clear();
-    ap_locations.clear();
-    item_name_groups.clear();
-    level_to_keycards.clear();
-    item_map.clear();
-
-    WorldOptions_Init(game);
+    WorldOptions_Init(game, ctx.world_options, ctx.errors);
 
     game->warnings.no_exit_connection = 0;
     game->warnings.location_no_region = 0;
 
-    ap_locations.reserve(600);
-    ap_items.reserve(300);
+    ctx.ap_locations.reserve(600);
+    ctx.ap_items.reserve(300);
 
-    use_extended_names = game->extended_names;
+    ctx.use_extended_names = game->extended_names;
 
     for (const auto& def : game->progression)
-        add_item(def, PROGRESSION);
+        add_item(ctx, def, PROGRESSION);
     for (const auto& def : game->useful)
-        add_item(def, USEFUL);
+        add_item(ctx, def, USEFUL);
     for (const auto& def : game->filler)
-        add_item(def, FILLER);
+        add_item(ctx, def, FILLER);
     
     std::vector<level_t*> levels;
     std::map<int, std::vector<level_t*>> levels_map;
@@ -640,31 +653,29 @@ int generate(game_t* game)
 
         auto map = level->map;
         level->sectors.resize(map->sectors.size());
+        level->thing_locations.assign(map->things.size(), -1);
         std::string lvl_prefix = level->name + std::string(" - ");
 
         for (int i = 0, len = (int)level->map->things.size(); i < len; ++i)
         {
             const auto& thing = level->map->things[i];
-            auto loc_it = game->location_doom_types.find(thing.type);
+            const auto& type_info = game->doom_types[thing.type];
 
             if (
-                loc_it == game->location_doom_types.end() // Not a location
+                !type_info.is_location() // Not a location
                 || (thing.flags & THING_FLAG_MP_ONLY) // Multiplayer only flag set
             )
                 continue;
 
-            for (const auto& key_def : game->keys)
+            if (type_info.key != -1)
             {
-                if (key_def.item.doom_type == thing.type)
-                {
-                    level_to_keycards[(uintptr_t)level][0] = add_unique(key_def, PROGRESSION, thing, level, i);
-                    level->keys[key_def.key] = true;
-                    level->use_skull[key_def.key] = key_def.use_skull;
-                    break;
-                }
+                const auto& key_def = game->keys[type_info.key];
+                ctx.level_to_keycards[(uintptr_t)level][0] = add_unique(ctx, key_def, PROGRESSION, thing, level, i);
+                level->keys[key_def.key] = true;
+                level->use_skull[key_def.key] = key_def.use_skull;
             }
 
-            add_loc(lvl_prefix + loc_it->second, thing, level, i, next_loc++);
+            add_loc(ctx, lvl_prefix + game->doom_types.location_names[type_info.location], thing, level, i, next_loc++);
         }
 
         // Make exit location
@@ -689,12 +700,13 @@ int generate(game_t* game)
                 }
             }
         }
-        OLogW(level->name + " has no region that connects to the Exit.");
+        log_warning(level->name + " has no region that connects to the Exit.");
         complete_loc.region_name = "Hub @ Entrance to " + level->name;
         ++game->warnings.no_exit_connection;
 
     found_exit_connection:
-        ap_locations.push_back(complete_loc);
+        ctx.location_names.insert(complete_loc.name);
+        ctx.ap_locations.push_back(complete_loc);
     }
 
     // Lastly, add level items. We want to add more levels in the future and not shift all existing item IDs
@@ -711,51 +723,64 @@ int generate(game_t* game)
 
     for (auto level : levels)
     {
-        add_item(level_unlock_item, PROGRESSION|USEFUL, level);
-        add_item(level_complete_item, PROGRESSION, level);
+        add_item(ctx, level_unlock_item, PROGRESSION|USEFUL, level);
+        add_item(ctx, level_complete_item, PROGRESSION, level);
 
         for (const auto& def : game->unique_progression)
-            add_item(def, PROGRESSION, level);
+            add_item(ctx, def, PROGRESSION, level);
         for (const auto& def : game->unique_useful)
-            add_item(def, USEFUL, level);
+            add_item(ctx, def, USEFUL, level);
         for (const auto& def : game->unique_filler)
-            add_item(def, FILLER, level);
+            add_item(ctx, def, FILLER, level);
     }
 
     // Sort item and location IDs for cleanliness
-    std::sort(ap_locations.begin(), ap_locations.end(), [](const ap_location_t& a, const ap_location_t& b) { return a.id < b.id; });
-    std::sort(ap_items.begin(), ap_items.end(), [](const ap_item_t& a, const ap_item_t& b) { return a.id < b.id; });
+    std::sort(ctx.ap_locations.begin(), ctx.ap_locations.end(), [](const ap_location_t& a, const ap_location_t& b) { return a.id < b.id; });
+    std::sort(ctx.ap_items.begin(), ctx.ap_items.end(), [](const ap_item_t& a, const ap_item_t& b) { return a.id < b.id; });
 
     // Set up bounding box location regions. Bounding box regions override sector regions.
-    for (auto& loc : ap_locations)
+    for (auto& loc : ctx.ap_locations)
     {
         if (loc.doom_thing_index < 0) continue;
         auto level = get_level(loc.idx);
-        for (bb_t& bb : level->map_state->bbs)
-        {
-            if (bb.region > -1 && bb.region < (int)level->map_state->regions.size() && bb.point_inside(loc.x >> 16, loc.y >> 16))
-            {
-                loc.region_name = level->name + " @ " + level->map_state->regions[bb.region].name;
-                break;
-            }
-        }
+        int override_bb = level->map_state->get_override_bb_at(loc.x >> 16, loc.y >> 16);
+        if (override_bb != -1)
+            loc.region_name = level->name + " @ " + level->map_state->regions[level->map_state->bbs[override_bb].region].name;
     }
 
-    // Fill in locations into level's sectors
-    for (int i = 0, len = (int)ap_locations.size(); i < len; ++i)
+    // Fill in locations into level's sectors. Each level's locations are looked up in one batch.
     {
-        auto& loc = ap_locations[i];
-        if (loc.doom_thing_index < 0) continue;
-        auto level = get_level(loc.idx);
-        auto subsector = point_in_subsector(loc.x, loc.y, get_map(loc.idx));
-        if (subsector)
+        std::map<level_t*, std::vector<int>> level_locations;
+        for (int i = 0, len = (int)ctx.ap_locations.size(); i < len; ++i)
         {
-            level->sectors[subsector->sector].locations.push_back(i);
-            //loc.sector = subsector->sector; // removed: never used
+            if (ctx.ap_locations[i].doom_thing_index < 0) continue;
+            level_locations[get_level(ctx.ap_locations[i].idx)].push_back(i);
         }
-        else
+
+        std::vector<int> xs, ys, subsectors;
+        for (auto& kv : level_locations)
         {
-            OLogE("Cannot find sector for location: " + loc.name);
+            auto level = kv.first;
+            const auto& loc_indices = kv.second;
+            int count = (int)loc_indices.size();
+
+            xs.resize(count);
+            ys.resize(count);
+            subsectors.resize(count);
+            for (int j = 0; j < count; ++j)
+            {
+                xs[j] = ctx.ap_locations[loc_indices[j]].x;
+                ys[j] = ctx.ap_locations[loc_indices[j]].y;
+            }
+            locate_points(level->map, xs.data(), ys.data(), count, subsectors.data());
+
+            for (int j = 0; j < count; ++j)
+            {
+                if (subsectors[j] >= 0)
+                    level->sectors[level->map->subsectors[subsectors[j]].sector].locations.push_back(loc_indices[j]);
+                else
+                    log_error("Cannot find sector for location: " + ctx.ap_locations[loc_indices[j]].name);
+            }
         }
     }
 
@@ -765,7 +790,7 @@ int generate(game_t* game)
 #define ERROR_DEFAULT_EPISODE 0b100
     unsigned int errored = 0b111;
 
-    for (const auto& kv : item_name_groups)
+    for (const auto& kv : ctx.item_name_groups)
     {
         if (kv.first == "Junk")
             errored &= ~ERROR_JUNK_GROUP;
@@ -788,17 +813,17 @@ int generate(game_t* game)
 
         for (const std::string& error : error_list)
         {
-            OLogE(error);
-            OnScreenMessages::AddError(error);
+            log_error(error);
+            ctx.errors.push_back(error);
         }
 
-        WorldOptions_Deinit();
-        delete world;
+        WorldOptions_Deinit(ctx.world_options);
+        delete ctx.world;
         for (auto level : levels) delete level;
         return 1;
     }
 
-    OLog(std::to_string(ap_locations.size()) + " locations, " + std::to_string(ap_items.size()) + " items");
+    log_info(std::to_string(ctx.ap_locations.size()) + " locations, " + std::to_string(ctx.ap_items.size()) + " items");
 
     // ------------------------------------------------------------------------
     // APWorld output begins here
@@ -868,8 +893,8 @@ int generate(game_t* game)
                 {
                     for (auto loci : level->sectors[sectori].locations)
                     {
-                        if (ap_locations[loci].region_name.empty())
-                            ap_locations[loci].region_name = region_name;
+                        if (ctx.ap_locations[loci].region_name.empty())
+                            ctx.ap_locations[loci].region_name = region_name;
                     }
                 }
 
@@ -903,7 +928,7 @@ int generate(game_t* game)
         Json::Value itemtable_json;
         Json::Value itemgroups_json;
 
-        for (const auto& item : ap_items)
+        for (const auto& item : ctx.ap_items)
         {
             const std::string &item_id = std::to_string(item.id);
 
@@ -923,7 +948,7 @@ int generate(game_t* game)
         }
 
         // item_name_groups
-        for (const auto& kv : item_name_groups)
+        for (const auto& kv : ctx.item_name_groups)
         {
             itemgroups_json[kv.first] = Json::arrayValue;
             for (const auto& item_name : kv.second)
@@ -939,7 +964,7 @@ int generate(game_t* game)
         Json::Value locgroups_json;
         Json::Value deathlogic_json = Json::arrayValue;
 
-        for (const auto& location : ap_locations)
+        for (const auto& location : ctx.ap_locations)
         {
             const std::string &level_name = get_level_name(location.idx);
             const std::string &loc_id = std::to_string(location.id);
@@ -947,7 +972,7 @@ int generate(game_t* game)
 
             if (region_name.empty())
             {
-                OLogW("Location '" + location.name + "' is not marked as unreachable, and is not associated with a region.");
+                log_warning("Location '" + location.name + "' is not marked as unreachable, and is not associated with a region.");
                 region_name = "Hub @ Entrance to " + level_name;
                 ++game->warnings.location_no_region;
             }
@@ -1013,7 +1038,7 @@ int generate(game_t* game)
             ap_json["helpful_item_weight"] = helpfulweight_json;
         //world->AddJson(zip_world_path + "filler.json", ap_json, false);
     }
-    world->AddJson(zip_world_path + game->short_name + ".data.json", ap_json, false);
+    ctx.world->AddJson(zip_world_path + game->short_name + ".data.json", ap_json, false);
 
     // ========================================================================
 
@@ -1044,9 +1069,9 @@ int generate(game_t* game)
     {
         const auto dirsep = wad_path.find_last_of('/');
         std::string wad_name = wad_path.substr(dirsep == std::string::npos ? 0 : dirsep + 1);
-        if (!world->AddFile(zip_wad_path + wad_name, wad_path))
+        if (!ctx.world->AddFile(zip_wad_path + wad_name, wad_path))
         {
-            OnScreenMessages::AddError("Couldn't add " + wad_path + " to the APWorld!");
+            ctx.errors.push_back("Couldn't add " + wad_path + " to the APWorld!");
             continue;
         }
 
@@ -1057,11 +1082,11 @@ int generate(game_t* game)
 
     // Generate the game def json that contains all the info for apdoom
     std::string defs_path = zip_world_path + game->short_name + ".game.json";
-    world->AddJson(defs_path, generate_game_defs_json(game, levels_map));
+    ctx.world->AddJson(defs_path, generate_game_defs_json(ctx, levels_map));
     info_json["definitions"] = defs_path;
 
     // Lastly generate the apworld manifest
-    world->AddJson(zip_world_path + "archipelago.json", generate_apworld_manifest(game, info_json));
+    ctx.world->AddJson(zip_world_path + "archipelago.json", generate_apworld_manifest(ctx, info_json));
 
     // ========================================================================
 
@@ -1120,21 +1145,28 @@ int generate(game_t* game)
     if (game->check_sanity)
         opts.emplace_back("check_sanity", PyOptionType::CheckSanity);
 
-    WorldOptions_MixinPyOptions(game, opts);
+    WorldOptions_MixinPyOptions(game, ctx.world_options, opts);
 
     bool vendor_id1common = !is_world_folder; // May be an independent option later
-    Py_SetCommonLibVendored(vendor_id1common);
-    world->AddSStream(zip_world_path + "options.py", Py_CreateOptionsPy(game, opts));
-    world->AddSStream(zip_world_path + "__init__.py", Py_CreateInitPy(game, is_world_folder));
+    {
+        std::stringstream pystream;
+        Py_CreateOptionsPy(pystream, game, opts, vendor_id1common);
+        ctx.world->AddSStream(zip_world_path + "options.py", pystream);
+    }
+    {
+        std::stringstream pystream;
+        Py_CreateInitPy(pystream, game, ctx.world_options, is_world_folder, vendor_id1common);
+        ctx.world->AddSStream(zip_world_path + "__init__.py", pystream);
+    }
 
     if (vendor_id1common)
     {
         int result = 0;
-        result += world->AddFile(zip_world_path + "id1common/__init__.py", "./assets/py/id1common/__init__.py");
-        result += world->AddFile(zip_world_path + "id1common/options.py", "./assets/py/id1common/options.py");
-        result += world->AddFile(zip_world_path + "id1common/LICENSE", "./assets/py/id1common/LICENSE");
+        result += ctx.world->AddFile(zip_world_path + "id1common/__init__.py", "./assets/py/id1common/__init__.py");
+        result += ctx.world->AddFile(zip_world_path + "id1common/options.py", "./assets/py/id1common/options.py");
+        result += ctx.world->AddFile(zip_world_path + "id1common/LICENSE", "./assets/py/id1common/LICENSE");
         if (result != 3)
-            OnScreenMessages::AddError("Couldn't add the id1common Python module to the APWorld!");
+            ctx.errors.push_back("Couldn't add the id1common Python module to the APWorld!");
     }
 
     // ========================================================================
@@ -1158,7 +1190,7 @@ int generate(game_t* game)
                 int index = location_kv.first;
 
                 fprintf(fout, "%s,", level->name.c_str());
-                fprintf(fout, "%s,", game->location_doom_types[level->map->things[index].type].c_str());
+                fprintf(fout, "%s,", game->doom_types.location_name(level->map->things[index].type).c_str());
                 fprintf(fout, "%i,", index);
                 fprintf(fout, "%s,", escape_csv(location.name).c_str());
                 fprintf(fout, "%s,\n", escape_csv(location.description).c_str());
@@ -1171,16 +1203,16 @@ int generate(game_t* game)
     long runtime_end = get_runtime_us();
 
     if (game->warnings.no_exit_connection)
-        OnScreenMessages::AddWarning(std::to_string(game->warnings.no_exit_connection) + " level(s) are missing Exit connections.");
+        ctx.warnings.push_back(std::to_string(game->warnings.no_exit_connection) + " level(s) are missing Exit connections.");
     if (game->warnings.location_no_region)
-        OnScreenMessages::AddWarning(std::to_string(game->warnings.location_no_region) + " location(s) are not associated with any regions.");
+        ctx.warnings.push_back(std::to_string(game->warnings.location_no_region) + " location(s) are not associated with any regions.");
 
-    if (!world->Finalize())
-        OnScreenMessages::AddError("Couldn't create '" + world->GetOutputPathName() + "'.");
+    if (!ctx.world->Finalize())
+        ctx.errors.push_back("Couldn't create '" + ctx.world->GetOutputPathName() + "'.");
     else
-        OnScreenMessages::AddNotice("Created world '" + world->GetOutputPathName() + "' successfully (" + compare_runtime(runtime_start, runtime_end) + "sec.)");
+        ctx.notices.push_back("Created world '" + ctx.world->GetOutputPathName() + "' successfully (" + compare_runtime(runtime_start, runtime_end) + "sec.)");
 
-    OLog("Generation complete: " 
+    log_info("Generation complete: " 
         + compare_runtime(runtime_start, runtime_end) + " sec. total, "
         + compare_runtime(runtime_start, runtime_output) + " sec. assembling, "
         + compare_runtime(runtime_output, runtime_end) + " sec. output");
@@ -1188,8 +1220,66 @@ int generate(game_t* game)
     // TODO: Pop tracker logic
 
     // Clean up
-    WorldOptions_Deinit();
-    delete world;
+    WorldOptions_Deinit(ctx.world_options);
+    delete ctx.world;
     for (auto level : levels) delete level;
     return 0;
 }
+
+static void show_generation_messages(const generation_context_t& ctx)
+{
+    for (const auto& error : ctx.errors)
+        OnScreenMessages::AddError(error);
+    for (const auto& warning : ctx.warnings)
+        OnScreenMessages::AddWarning(warning);
+    for (const auto& notice : ctx.notices)
+        OnScreenMessages::AddNotice(notice);
+}
+
+int generate(game_t* game)
+{
+    generation_context_t ctx;
+    ctx.game = game;
+    int result = generate_world(ctx);
+    show_generation_messages(ctx);
+    return result;
+}
+
+// Generations share nothing, so each game gets a worker of its own, up to one per core.
+// Everything shows up the same as generating the games one after another.
+int generate_all(const std::vector<game_t*>& games)
+{
+    long runtime_start = get_runtime_us();
+    std::vector<generation_context_t> contexts(games.size());
+    std::vector<int> results(games.size(), 1);
+    std::atomic<size_t> next_game{0};
+
+    auto worker = [&]()
+    {
+        for (size_t i = next_game++; i < games.size(); i = next_game++)
+        {
+            contexts[i].game = games[i];
+            results[i] = generate_world(contexts[i]);
+        }
+    };
+
+    size_t thread_count = std::min<size_t>(games.size(), std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < thread_count; ++i)
+        workers.emplace_back(worker);
+    worker();
+    for (auto& thread : workers)
+        thread.join();
+
+    int failed = 0;
+    for (size_t i = 0; i < games.size(); ++i)
+    {
+        show_generation_messages(contexts[i]);
+        if (results[i])
+            ++failed;
+    }
+
+    log_info("Generated " + std::to_string(games.size() - failed) + " of " + std::to_string(games.size())
+        + " worlds: " + compare_runtime(runtime_start, get_runtime_us()) + " sec. total");
+    return failed;
+}
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <vector>
+
 
 struct game_t;
 
 
 int generate(game_t* game);
+int generate_all(const std::vector<game_t*>& games); // Returns how many failed
@@ -0,0 +1,409 @@
+#pragma once
+
+#include <string>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+// Reads JSON straight from memory, one value at a time, without building a tree.
+// The caller walks the document in the order it's laid out:
+//
+//	if (reader.BeginObject())
+//		while (reader.NextKey(key))
+//			if (key == "x") x = reader.GetInt();
+//			else reader.Skip();
+//
+// Getters coerce like Json::Value::as*() for the types we use, and return a default for anything
+// else. After a syntax error everything returns defaults and Failed() is true.
+class JsonPullReader
+{
+	const char* p;
+	const char* end;
+	bool failed = false;
+	bool first = false; // Next NextKey/NextElement is the first of its container
+
+	void Fail(void)
+	{
+		failed = true;
+		p = end;
+	}
+
+	// Comments too, hand written .game.json files have them like jsoncpp allows
+	void SkipWhitespace(void)
+	{
+		while (p < end)
+		{
+			if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+				++p;
+			else if (*p == '/' && end - p >= 2 && p[1] == '/')
+			{
+				while (p < end && *p != '\n')
+					++p;
+			}
+			else if (*p == '/' && end - p >= 2 && p[1] == '*')
+			{
+				p += 2;
+				while (end - p >= 2 && !(p[0] == '*' && p[1] == '/'))
+					++p;
+				p = end - p >= 2 ? p + 2 : end;
+			}
+			else
+				break;
+		}
+	}
+
+	char Peek(void)
+	{
+		SkipWhitespace();
+		return p < end ? *p : '\0';
+	}
+
+	bool Consume(char c)
+	{
+		if (Peek() != c)
+			return false;
+		++p;
+		return true;
+	}
+
+	bool ConsumeLiteral(const char* literal, size_t size)
+	{
+		if ((size_t)(end - p) < size || memcmp(p, literal, size) != 0)
+		{
+			Fail();
+			return false;
+		}
+		p += size;
+		return true;
+	}
+
+	static void AppendUtf8(std::string& str, uint32_t cp)
+	{
+		if (cp < 0x80)
+			str += (char)cp;
+		else if (cp < 0x800)
+		{
+			str += (char)(0xC0 | (cp >> 6));
+			str += (char)(0x80 | (cp & 0x3F));
+		}
+		else if (cp < 0x10000)
+		{
+			str += (char)(0xE0 | (cp >> 12));
+			str += (char)(0x80 | ((cp >> 6) & 0x3F));
+			str += (char)(0x80 | (cp & 0x3F));
+		}
+		else
+		{
+			str += (char)(0xF0 | (cp >> 18));
+			str += (char)(0x80 | ((cp >> 12) & 0x3F));
+			str += (char)(0x80 | ((cp >> 6) & 0x3F));
+			str += (char)(0x80 | (cp & 0x3F));
+		}
+	}
+
+	bool ReadHex4(uint32_t& cp)
+	{
+		if (end - p < 4)
+			return false;
+		cp = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			char c = *p++;
+			cp <<= 4;
+			if (c >= '0' && c <= '9') cp |= c - '0';
+			else if (c >= 'a' && c <= 'f') cp |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') cp |= c - 'A' + 10;
+			else return false;
+		}
+		return true;
+	}
+
+	// Expects to be on the opening quote
+	void ReadString(std::string& str)
+	{
+		str.clear();
+		++p;
+		while (true)
+		{
+			const char* start = p;
+			while (p < end && *p != '"' && *p != '\\')
+				++p;
+			str.append(start, p);
+			if (p >= end)
+			{
+				Fail();
+				return;
+			}
+			if (*p++ == '"')
+				return;
+
+			if (p >= end)
+			{
+				Fail();
+				return;
+			}
+			char c = *p++;
+			switch (c)
+			{
+				case '"': str += '"'; break;
+				case '\\': str += '\\'; break;
+				case '/': str += '/'; break;
+				case 'b': str += '\b'; break;
+				case 'f': str += '\f'; break;
+				case 'n': str += '\n'; break;
+				case 'r': str += '\r'; break;
+				case 't': str += '\t'; break;
+				case 'u':
+				{
+					uint32_t cp;
+					if (!ReadHex4(cp))
+					{
+						Fail();
+						return;
+					}
+					if (cp >= 0xD800 && cp <= 0xDBFF) // Surrogate pair
+					{
+						uint32_t low;
+						if (end - p < 2 || p[0] != '\\' || p[1] != 'u')
+						{
+							Fail();
+							return;
+						}
+						p += 2;
+						if (!ReadHex4(low) || low < 0xDC00 || low > 0xDFFF)
+						{
+							Fail();
+							return;
+						}
+						cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+					}
+					AppendUtf8(str, cp);
+					break;
+				}
+				default:
+					Fail();
+					return;
+			}
+		}
+	}
+
+	// Expects to be on the first character of the number
+	double ReadNumber(void)
+	{
+		const char* start = p;
+		if (p < end && *p == '-')
+			++p;
+		bool is_integer = true;
+		int64_t integer = 0;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			if (integer < 100000000000000000ll)
+				integer = integer * 10 + (*p - '0');
+			else
+				is_integer = false;
+			++p;
+		}
+		if (p < end && (*p == '.' || *p == 'e' || *p == 'E'))
+			is_integer = false;
+		if (is_integer)
+		{
+			if (p == start || (p == start + 1 && *start == '-'))
+			{
+				Fail();
+				return 0.0;
+			}
+			return *start == '-' ? -(double)integer : (double)integer;
+		}
+
+		// Rare in our files, let the C library get the rounding right
+		while (p < end && ((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' || *p == 'E' || *p == '+' || *p == '-'))
+			++p;
+		std::string number(start, p);
+		char* number_end;
+		double value = strtod(number.c_str(), &number_end);
+		if (number_end != number.c_str() + number.size())
+			Fail();
+		return value;
+	}
+
+	// Reads any scalar as a number, like asDouble() would
+	double ReadScalarNumber(double default_value)
+	{
+		char c = Peek();
+		if (c == '-' || (c >= '0' && c <= '9'))
+			return ReadNumber();
+		if (c == 't' && ConsumeLiteral("true", 4))
+			return 1.0;
+		if (c == 'f' && ConsumeLiteral("false", 5))
+			return 0.0;
+		if (c == 'n' && ConsumeLiteral("null", 4))
+			return default_value;
+		Skip();
+		return default_value;
+	}
+
+public:
+	JsonPullReader(const char* data, size_t size)
+		: p(data)
+		, end(data + size)
+	{
+	}
+
+	bool Failed(void) const { return failed; }
+
+	// For values that can be either, like a single string in place of an array
+	bool IsString(void) { return Peek() == '"'; }
+
+	// True if the value was an object, to iterate with NextKey(). Otherwise it's skipped.
+	bool BeginObject(void)
+	{
+		if (Peek() != '{')
+		{
+			Skip();
+			return false;
+		}
+		++p;
+		first = true;
+		return true;
+	}
+
+	bool NextKey(std::string& key)
+	{
+		if (Consume('}'))
+		{
+			first = false;
+			return false;
+		}
+		if (!first && !Consume(','))
+		{
+			Fail();
+			return false;
+		}
+		if (!first && Consume('}')) // Trailing comma
+			return false;
+		first = false;
+		if (Peek() != '"')
+		{
+			Fail();
+			return false;
+		}
+		ReadString(key);
+		if (!Consume(':'))
+		{
+			Fail();
+			return false;
+		}
+		return true;
+	}
+
+	// True if the value was an array, to iterate with NextElement(). Otherwise it's skipped.
+	bool BeginArray(void)
+	{
+		if (Peek() != '[')
+		{
+			Skip();
+			return false;
+		}
+		++p;
+		first = true;
+		return true;
+	}
+
+	bool NextElement(void)
+	{
+		if (Consume(']'))
+		{
+			first = false;
+			return false;
+		}
+		if (!first && !Consume(','))
+		{
+			Fail();
+			return false;
+		}
+		if (!first && Consume(']')) // Trailing comma
+			return false;
+		first = false;
+		return true;
+	}
+
+	// Skips the remaining members of the container being iterated
+	void SkipRest(bool is_array)
+	{
+		if (is_array)
+		{
+			while (NextElement())
+				Skip();
+		}
+		else
+		{
+			std::string key;
+			while (NextKey(key))
+				Skip();
+		}
+	}
+
+	void Skip(void)
+	{
+		char c = Peek();
+		if (c == '{')
+		{
+			BeginObject();
+			SkipRest(false);
+		}
+		else if (c == '[')
+		{
+			BeginArray();
+			SkipRest(true);
+		}
+		else if (c == '"')
+		{
+			std::string str;
+			ReadString(str);
+		}
+		else if (c == '-' || (c >= '0' && c <= '9'))
+			ReadNumber();
+		else if (c == 't')
+			ConsumeLiteral("true", 4);
+		else if (c == 'f')
+			ConsumeLiteral("false", 5);
+		else if (c == 'n')
+			ConsumeLiteral("null", 4);
+		else
+			Fail();
+		first = false;
+	}
+
+	int GetInt(int default_value = 0)
+	{
+		return (int)ReadScalarNumber((double)default_value);
+	}
+
+	double GetDouble(double default_value = 0.0)
+	{
+		return ReadScalarNumber(default_value);
+	}
+
+	bool GetBool(bool default_value = false)
+	{
+		return ReadScalarNumber(default_value ? 1.0 : 0.0) != 0.0;
+	}
+
+	std::string GetString(const std::string& default_value = "")
+	{
+		if (Peek() == '"')
+		{
+			std::string str;
+			ReadString(str);
+			return str;
+		}
+		Skip();
+		return default_value;
+	}
+
+	// Whole document was consumed
+	bool AtEnd(void)
+	{
+		return Peek() == '\0' && p >= end;
+	}
+};
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#if defined(WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <json/json.h>
+
+// FNV-1a, chainable by passing the previous result as 'hash'
+inline uint64_t hash_bytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull)
+{
+	auto bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+// Writes JSON straight to a file, laid out exactly like Json::StyledWriter would.
+// Output goes to "<path>.tmp", which only replaces <path> once it's complete and on disk.
+//
+// Containers are opened/closed as they are written. Arrays of scalars are given whole
+// (pre-formatted with the Format* helpers), since their layout depends on their length.
+// Objects must have at least one member.
+class StyledJsonWriter
+{
+	static constexpr size_t BUFFER_SIZE = 64 * 1024;
+	static constexpr size_t RIGHT_MARGIN = 74;
+
+	struct Scope
+	{
+		bool is_array;
+		bool has_values;
+	};
+
+	FILE* handle = nullptr;
+	std::string path;
+	std::string temp_path;
+	std::string buffer;
+	char last_char = '\0'; // Last character written, for indentation decisions
+	bool failed = false;
+	uint64_t hash = hash_bytes(nullptr, 0);
+	uint64_t size = 0;
+
+	std::string indent_string;
+	std::vector<Scope> scopes;
+
+	void Flush(void)
+	{
+		if (!handle) // Writing a fragment, everything stays in memory
+			return;
+		if (!buffer.empty())
+		{
+			if (fwrite(buffer.data(), 1, buffer.size(), handle) != buffer.size())
+				failed = true;
+			hash = hash_bytes(buffer.data(), buffer.size(), hash);
+			size += buffer.size();
+		}
+		buffer.clear();
+	}
+
+	void Write(const std::string& str)
+	{
+		if (str.empty())
+			return;
+		buffer += str;
+		last_char = str.back();
+		if (buffer.size() >= BUFFER_SIZE)
+			Flush();
+	}
+
+	void Write(char c)
+	{
+		buffer += c;
+		last_char = c;
+		if (buffer.size() >= BUFFER_SIZE)
+			Flush();
+	}
+
+	void WriteIndent(void)
+	{
+		if (last_char != '\0')
+		{
+			if (last_char == ' ') // Already indented
+				return;
+			if (last_char != '\n')
+				Write('\n');
+		}
+		Write(indent_string);
+	}
+
+	void WriteWithIndent(const std::string& str)
+	{
+		WriteIndent();
+		Write(str);
+	}
+
+	void Indent(void) { indent_string += "   "; }
+	void Unindent(void) { indent_string.resize(indent_string.size() - 3); }
+
+public:
+	~StyledJsonWriter(void)
+	{
+		Abort();
+	}
+
+	bool Open(const std::string& filename)
+	{
+		path = filename;
+		temp_path = filename + ".tmp";
+		handle = fopen(temp_path.c_str(), "wb");
+		buffer.reserve(BUFFER_SIZE + 1024);
+		return handle != nullptr;
+	}
+
+	// Flushes everything to disk and moves the file in place.
+	bool Commit(void)
+	{
+		if (!handle)
+			return false;
+		Write('\n');
+		Flush();
+		if (fflush(handle) != 0)
+			failed = true;
+#if defined(WIN32)
+		if (_commit(_fileno(handle)) != 0)
+			failed = true;
+#else
+		if (fsync(fileno(handle)) != 0)
+			failed = true;
+#endif
+		if (fclose(handle) != 0)
+			failed = true;
+		handle = nullptr;
+
+		if (!failed)
+		{
+			std::error_code ec;
+			std::filesystem::rename(temp_path, path, ec);
+			failed = (bool)ec;
+		}
+		if (failed)
+		{
+			std::error_code ec;
+			std::filesystem::remove(temp_path, ec);
+		}
+		return !failed;
+	}
+
+	// Drops the temp file, leaving whatever was at the destination untouched.
+	void Abort(void)
+	{
+		if (!handle)
+			return;
+		fclose(handle);
+		handle = nullptr;
+		std::error_code ec;
+		std::filesystem::remove(temp_path, ec);
+	}
+
+	// Of everything written to the file so far
+	uint64_t GetHash(void) const { return hash; }
+	uint64_t GetSize(void) const { return size; }
+
+	// Writes to memory instead, as if continuing inside 'depth' levels of containers
+	// right before a value. The result can be spliced back in with Raw().
+	void BeginFragment(int depth)
+	{
+		buffer.clear();
+		indent_string.assign(depth * 3, ' ');
+		last_char = ' ';
+		scopes.clear();
+	}
+
+	std::string EndFragment(void)
+	{
+		std::string fragment;
+		fragment.swap(buffer);
+		return fragment;
+	}
+
+	// Call before each element of an array opened with BeginArray.
+	void Element(void)
+	{
+		auto& scope = scopes.back();
+		if (!scope.has_values)
+		{
+			WriteWithIndent("[");
+			Indent();
+			scope.has_values = true;
+		}
+		else
+			Write(',');
+		WriteIndent();
+	}
+
+	void Key(const char* name)
+	{
+		auto& scope = scopes.back();
+		if (scope.has_values)
+			Write(',');
+		scope.has_values = true;
+		WriteWithIndent(Json::valueToQuotedString(name));
+		Write(" : ");
+	}
+
+	void BeginObject(void)
+	{
+		WriteWithIndent("{");
+		Indent();
+		scopes.push_back({false, false});
+	}
+
+	void EndObject(void)
+	{
+		scopes.pop_back();
+		Unindent();
+		WriteWithIndent("}");
+	}
+
+	// Array of objects or arrays, opened lazily so that empty arrays come out as []
+	void BeginArray(void)
+	{
+		scopes.push_back({true, false});
+	}
+
+	void EndArray(void)
+	{
+		bool has_values = scopes.back().has_values;
+		scopes.pop_back();
+		if (!has_values)
+		{
+			Write("[]");
+			return;
+		}
+		Unindent();
+		WriteWithIndent("]");
+	}
+
+	void Value(const std::string& formatted)
+	{
+		Write(formatted);
+	}
+
+	// Pre-written output, like a fragment
+	void Raw(const std::string& str)
+	{
+		Write(str);
+	}
+
+	void ScalarArray(const std::vector<std::string>& formatted)
+	{
+		size_t size = formatted.size();
+		if (size == 0)
+		{
+			Write("[]");
+			return;
+		}
+
+		size_t line_length = 4 + (size - 1) * 2; // '[ ' + ', '*n + ' ]'
+		for (const auto& value : formatted)
+			line_length += value.size();
+
+		if (size * 3 >= RIGHT_MARGIN || line_length >= RIGHT_MARGIN)
+		{
+			WriteWithIndent("[");
+			Indent();
+			for (size_t i = 0; i < size; ++i)
+			{
+				if (i > 0)
+					Write(',');
+				WriteWithIndent(formatted[i]);
+			}
+			Unindent();
+			WriteWithIndent("]");
+		}
+		else
+		{
+			Write("[ ");
+			for (size_t i = 0; i < size; ++i)
+			{
+				if (i > 0)
+					Write(", ");
+				Write(formatted[i]);
+			}
+			Write(" ]");
+		}
+	}
+
+	static std::string FormatInt(int value) { return Json::valueToString((Json::LargestInt)value); }
+	static std::string FormatDouble(double value) { return Json::valueToString(value); }
+	static std::string FormatBool(bool value) { return Json::valueToString(value); }
+	static std::string FormatString(const std::string& value) { return Json::valueToQuotedString(value.c_str()); }
+
+	// Shortest number that reads back as the same float
+	static std::string FormatFloat(float value)
+	{
+		char buffer[32];
+		for (int precision = 1; precision <= 9; ++precision)
+		{
+			snprintf(buffer, sizeof(buffer), "%.*g", precision, (double)value);
+			if ((float)strtod(buffer, nullptr) == value)
+				break;
+		}
+		return buffer;
+	}
+};
@@ -1,15 +1,14 @@
 #include "maps.h"
 
-#include <onut/onut.h>
-#include <onut/Dialogs.h>
-#include <onut/Strings.h>
-#include <onut/Point.h>
-
 #include <stdio.h>
 #include <algorithm>
+#include <cmath>
+#include <map>
 
 #include "data.h"
 #include "defs.h"
+#include "json_writer.hpp"
+#include "util.hpp"
 
 
 // ============================================================================
@@ -179,13 +178,20 @@ static bool try_load_lump(const char *lump_name,
 }
 
 
+template<typename T>
+static uint64_t hash_lump(const std::vector<T>& elements, uint64_t hash)
+{
+    return hash_bytes(elements.data(), elements.size() * sizeof(T), hash);
+}
+
+
 int FixedMul(int a, int b)
 {
     return ((int64_t) a * (int64_t) b) >> 16;
 }
 
 
-int point_on_side(int x, int y, node_t* node)
+int point_on_side(int x, int y, const node_t* node)
 {
     int	dx;
     int	dy;
@@ -237,7 +243,7 @@ int point_on_side(int x, int y, node_t* node)
 
 subsector_t* point_in_subsector(int x, int y, map_t* map)
 {
-    node_t*	node;
+    const node_t* node;
     int side;
     int nodenum;
 
@@ -258,29 +264,113 @@ subsector_t* point_in_subsector(int x, int y, map_t* map)
 }
 
 
+#define LOCATE_LANES 8
+
+// Same as point_in_subsector, but for many points at once. Points are walked down
+// the tree in groups of LOCATE_LANES; each step gathers every lane's node, then
+// runs point_on_side for all lanes as straight-line selects so the compiler can
+// vectorize it. Points already in a subsector just keep their result.
+void locate_points(const map_t* map, const int* xs, const int* ys, int count, int* subsectors)
+{
+    if (map->subsectors.empty())
+    {
+        for (int i = 0; i < count; ++i)
+            subsectors[i] = -1;
+        return;
+    }
+    if (map->nodes.empty())
+    {
+        for (int i = 0; i < count; ++i)
+            subsectors[i] = 0;
+        return;
+    }
+
+    const node_t* nodes = map->nodes.data();
+    const int root = (int)map->nodes.size() - 1;
+
+    for (int base = 0; base < count; base += LOCATE_LANES)
+    {
+        int lanes = std::min(LOCATE_LANES, count - base);
+
+        int x[LOCATE_LANES], y[LOCATE_LANES], nodenum[LOCATE_LANES];
+        for (int l = 0; l < LOCATE_LANES; ++l)
+        {
+            // Unused lanes start out done
+            x[l] = (l < lanes) ? xs[base + l] : 0;
+            y[l] = (l < lanes) ? ys[base + l] : 0;
+            nodenum[l] = (l < lanes) ? root : NF_SUBSECTOR;
+        }
+
+        while (true)
+        {
+            int active = 0;
+            int nx[LOCATE_LANES], ny[LOCATE_LANES], ndx[LOCATE_LANES], ndy[LOCATE_LANES];
+            int child0[LOCATE_LANES], child1[LOCATE_LANES];
+            for (int l = 0; l < LOCATE_LANES; ++l)
+            {
+                const node_t& node = nodes[(nodenum[l] & NF_SUBSECTOR) ? 0 : nodenum[l]];
+                active |= !(nodenum[l] & NF_SUBSECTOR);
+                nx[l] = node.x;
+                ny[l] = node.y;
+                ndx[l] = node.dx;
+                ndy[l] = node.dy;
+                child0[l] = node.children[0];
+                child1[l] = node.children[1];
+            }
+            if (!active)
+                break;
+
+            for (int l = 0; l < LOCATE_LANES; ++l)
+            {
+                int dx = x[l] - nx[l];
+                int dy = y[l] - ny[l];
+                int left = FixedMul(ndy[l] >> 16, dx);
+                int right = FixedMul(dy, ndx[l] >> 16);
+
+                int side_vertical = (x[l] <= nx[l]) ? (ndy[l] > 0) : (ndy[l] < 0);
+                int side_horizontal = (y[l] <= ny[l]) ? (ndx[l] < 0) : (ndx[l] > 0);
+                int side_sign = (ndy[l] ^ dx) < 0;
+                int side_cross = !(right < left);
+                int side = (ndy[l] ^ ndx[l] ^ dx ^ dy) < 0 ? side_sign : side_cross;
+                side = !ndy[l] ? side_horizontal : side;
+                side = !ndx[l] ? side_vertical : side;
+
+                int next = side ? child1[l] : child0[l];
+                nodenum[l] = (nodenum[l] & NF_SUBSECTOR) ? nodenum[l] : next;
+            }
+        }
+
+        for (int l = 0; l < lanes; ++l)
+        {
+            int subsectornum = nodenum[l] & ~NF_SUBSECTOR;
+            subsectors[base + l] = (subsectornum < (int)map->subsectors.size()) ? subsectornum : -1;
+        }
+    }
+}
+
+
 // Replace convex polygon with right side of convex polygon cut by infinite line at point with ray delta
-std::vector<Vector2> cut_convex_polygon(const std::vector<Vector2>& polygon, Vector2 point, Vector2 delta)
+std::vector<vec2_t> cut_convex_polygon(const std::vector<vec2_t>& polygon, vec2_t point, vec2_t delta)
 {
-  std::vector<Vector2> cut;
+  std::vector<vec2_t> cut;
 
-  Vector2 dnorm = delta;
-  dnorm.Normalize();
+  vec2_t dnorm = delta.normalized();
   for (int j = 0, len = (int)polygon.size(), i = len - 1; j < len; i = j++)
   {
-    Vector2 a = polygon[i];
-    Vector2 b = polygon[j];
+    vec2_t a = polygon[i];
+    vec2_t b = polygon[j];
 
-    Vector2 a_on_line = point + dnorm * (a - point).Dot(dnorm);
-    Vector2 b_on_line = point + dnorm * (b - point).Dot(dnorm);
+    vec2_t a_on_line = point + dnorm * (a - point).dot(dnorm);
+    vec2_t b_on_line = point + dnorm * (b - point).dot(dnorm);
     const float online_epsilon = 0.01f;
-    if (Vector2::Distance(a_on_line, a) < online_epsilon && Vector2::Distance(b_on_line, b) < online_epsilon)
+    if (vec2_t::distance(a_on_line, a) < online_epsilon && vec2_t::distance(b_on_line, b) < online_epsilon)
     {
       cut.push_back(a);
       continue;
     }
 
-    bool a_side = delta.Cross(a - point).z > 0.0;
-    bool b_side = delta.Cross(b - point).z > 0.0;
+    bool a_side = delta.cross(a - point) > 0.0;
+    bool b_side = delta.cross(b - point) > 0.0;
 
     if (a_side)
       cut.push_back(a);
@@ -288,8 +378,8 @@ std::vector<Vector2> cut_convex_polygon(const std::vector<Vector2>& polygon, Vec
     if (a_side != b_side)
     {
       // add intersection for a-b and line
-      Vector2 d = b - a;
-      float t = (point - a).Cross(delta).z / d.Cross(delta).z;
+      vec2_t d = b - a;
+      float t = (point - a).cross(delta) / d.cross(delta);
       cut.push_back(a + d * t);
     }
   }
@@ -298,13 +388,13 @@ std::vector<Vector2> cut_convex_polygon(const std::vector<Vector2>& polygon, Vec
 }
 
 
-void triangulate_polygon_for_subsector(map_t* map, const std::vector<Vector2>& polygon, int subsectornum)
+void triangulate_polygon_for_subsector(map_t* map, const std::vector<vec2_t>& polygon, int subsectornum)
 {
   int sectornum = map->subsectors[subsectornum].sector;
   const map_subsector_t& subsector = map->map_subsectors[subsectornum];
 
   // clip against each seg in this subsector
-  std::vector<Vector2> clip = polygon;
+  std::vector<vec2_t> clip = polygon;
   for (int i = 0; i < subsector.numsegs; ++i)
   {
     int segnum = subsector.firstseg + i;
@@ -313,8 +403,8 @@ void triangulate_polygon_for_subsector(map_t* map, const std::vector<Vector2>& p
     const map_vertex_t& v1 = map->vertexes[seg.v1];
     const map_vertex_t& v2 = map->vertexes[seg.v2];
 
-    Vector2 a = Vector2((float)v1.x, (float)v1.y);
-    Vector2 b = Vector2((float)v2.x, (float)v2.y);
+    vec2_t a = vec2_t((float)v1.x, (float)v1.y);
+    vec2_t b = vec2_t((float)v2.x, (float)v2.y);
     clip = cut_convex_polygon(clip, a, a - b);
   }
 
@@ -335,7 +425,7 @@ void triangulate_polygon_for_subsector(map_t* map, const std::vector<Vector2>& p
 }
 
 
-void triangulate_polygon_for_node(map_t* map, const std::vector<Vector2>& polygon, int nodenum)
+void triangulate_polygon_for_node(map_t* map, const std::vector<vec2_t>& polygon, int nodenum)
 {
   if (nodenum & NF_SUBSECTOR_VANILLA)
   {
@@ -345,8 +435,8 @@ void triangulate_polygon_for_node(map_t* map, const std::vector<Vector2>& polygo
 
   const map_node_t& node = map->map_nodes[nodenum];
 
-  Vector2 cut_point(node.x, node.y);
-  Vector2 cut_ray(node.dx, node.dy);
+  vec2_t cut_point(node.x, node.y);
+  vec2_t cut_ray(node.dx, node.dy);
 
   triangulate_polygon_for_node(map, cut_convex_polygon(polygon, cut_point, -cut_ray), node.children[0]);
   triangulate_polygon_for_node(map, cut_convex_polygon(polygon, cut_point, cut_ray), node.children[1]);
@@ -362,29 +452,30 @@ void triangulate_map(map_t* map)
   }
 
   // initial polygon is map bounding box
-  std::vector<Vector2> polygon = {
-    Vector2(map->bb[0], map->bb[1]),
-    Vector2(map->bb[2], map->bb[1]),
-    Vector2(map->bb[2], map->bb[3]),
-    Vector2(map->bb[0], map->bb[3])
+  std::vector<vec2_t> polygon = {
+    vec2_t(map->bb[0], map->bb[1]),
+    vec2_t(map->bb[2], map->bb[1]),
+    vec2_t(map->bb[2], map->bb[3]),
+    vec2_t(map->bb[0], map->bb[3])
   };
 
   triangulate_polygon_for_node(map, polygon, (int)map->nodes.size() - 1);
 }
 
 
-OTextureRef load_sprite(const std::vector<game_wad_t>& wad_list, const char* lump_name, const uint8_t* pal)
+// Decodes to RGBA. The editor makes textures out of it later, on the main thread.
+bool load_sprite(const std::vector<game_wad_t>& wad_list, const char* lump_name, const uint8_t* pal, ap_item_def_t& item)
 {
     auto raw_data = load_lump(wad_list, lump_name);
-    if (raw_data.empty()) return nullptr;
+    if (raw_data.empty()) return false;
 
     patch_header_t header;
     memcpy(&header, raw_data.data(), sizeof(patch_header_t));
     uint32_t* columnofs = new uint32_t[header.width * sizeof(uint32_t)];
     memcpy(columnofs, raw_data.data() + sizeof(patch_header_t), header.width * sizeof(uint32_t));
 
-    std::vector<uint8_t> img_data;
-    img_data.resize(header.width * header.height * 4);
+    std::vector<uint8_t>& img_data = item.icon_pixels;
+    img_data.assign(header.width * header.height * 4, 0);
 
     for (int x = 0; x < header.width; ++x)
     {
@@ -409,21 +500,23 @@ OTextureRef load_sprite(const std::vector<game_wad_t>& wad_list, const char* lum
     }
 
     delete[] columnofs;
-    return OTexture::createFromData(img_data.data(), {header.width, header.height}, false);
+    item.icon_width = header.width;
+    item.icon_height = header.height;
+    return true;
 }
 
-Color get_color_for_arrow_type(arrowtype_t type)
+color_t get_color_for_arrow_type(arrowtype_t type)
 {
     switch (type)
     {
-        case ARROW_DOOR_SR:  return Color(1, 0, 1);
-        case ARROW_DOOR_WR:  return Color(1, 0.5f, 1);
-        case ARROW_LIFT_SR:  return Color(0, 1, 1);
-        case ARROW_LIFT_WR:  return Color(0.5f, 1, 1);
-        case ARROW_CRUSHER:  return Color(1, 0, 0);
-        case ARROW_STAIR:    return Color(0, 0, 1);
-        case ARROW_TELEPORT: return Color(1, 1, 0.5f);
-        default:             return Color(1, 1, 1);
+        case ARROW_DOOR_SR:  return color_t(1, 0, 1);
+        case ARROW_DOOR_WR:  return color_t(1, 0.5f, 1);
+        case ARROW_LIFT_SR:  return color_t(0, 1, 1);
+        case ARROW_LIFT_WR:  return color_t(0.5f, 1, 1);
+        case ARROW_CRUSHER:  return color_t(1, 0, 0);
+        case ARROW_STAIR:    return color_t(0, 0, 1);
+        case ARROW_TELEPORT: return color_t(1, 1, 0.5f);
+        default:             return color_t(1, 1, 1);
     }
 }
 
@@ -577,7 +670,166 @@ arrowtype_t get_arrow_type(int special)
     return ARROW_OTHER;
 }
 
-bool init_maps(game_t& game)
+uint8_t get_edge_kind(int special)
+{
+    switch (special)
+    {
+        case LT_NONE:
+            return 0;
+
+        case LT_DR_DOOR_BLUE_OPEN_WAIT_CLOSE:
+        case LT_DR_DOOR_RED_OPEN_WAIT_CLOSE:
+        case LT_DR_DOOR_YELLOW_OPEN_WAIT_CLOSE:
+        case LT_D1_DOOR_BLUE_OPEN_STAY:
+        case LT_D1_DOOR_RED_OPEN_STAY:
+        case LT_D1_DOOR_YELLOW_OPEN_STAY:
+        case LT_SR_DOOR_BLUE_OPEN_STAY_FAST:
+        case LT_SR_DOOR_RED_OPEN_STAY_FAST:
+        case LT_SR_DOOR_YELLOW_OPEN_STAY_FAST:
+        case LT_S1_DOOR_BLUE_OPEN_STAY_FAST:
+        case LT_S1_DOOR_RED_OPEN_STAY_FAST:
+        case LT_S1_DOOR_YELLOW_OPEN_STAY_FAST:
+            return EDGE_LOCKED_DOOR;
+    }
+
+    switch (get_arrow_type(special))
+    {
+        case ARROW_DOOR_SR:
+        case ARROW_DOOR_WR:  return EDGE_DOOR;
+        case ARROW_LIFT_SR:
+        case ARROW_LIFT_WR:  return EDGE_LIFT;
+        case ARROW_TELEPORT: return EDGE_TELEPORT;
+        default:             return EDGE_OTHER;
+    }
+}
+
+// Builds the sector adjacency graph from two-sided linedefs.
+// Sectors moved by a tagged special (remote doors, lifts) get that special's kind
+// on every edge leading into them, and teleport lines get a one-way edge to
+// every sector they can send the player to.
+void build_sector_graph(map_t* map)
+{
+    int sector_count = (int)map->map_sectors.size();
+
+    std::map<int, std::vector<int>> sectors_by_tag;
+    for (int i = 0; i < sector_count; ++i)
+    {
+        if (map->map_sectors[i].tag != 0)
+            sectors_by_tag[map->map_sectors[i].tag].push_back(i);
+    }
+
+    std::vector<uint8_t> tagged_kind(sector_count, 0);
+    for (const auto& line_def : map->linedefs)
+    {
+        if (line_def.special_type == 0 || line_def.sector_tag == 0) continue;
+        uint8_t kind = get_edge_kind(line_def.special_type);
+        if (kind == EDGE_TELEPORT) continue; // Teleporting doesn't move the destination sector
+        for (int sectori : sectors_by_tag[line_def.sector_tag])
+            tagged_kind[sectori] |= kind;
+    }
+
+    struct directed_edge_t
+    {
+        int from;
+        sector_edge_t edge;
+    };
+    std::vector<directed_edge_t> edges;
+
+    for (int i = 0, len = (int)map->linedefs.size(); i < len; ++i)
+    {
+        const auto& line_def = map->linedefs[i];
+        uint8_t kind = get_edge_kind(line_def.special_type);
+
+        int front = -1, back = -1;
+        if (line_def.front_sidedef >= 0 && line_def.front_sidedef < (int)map->sidedefs.size())
+            front = map->sidedefs[line_def.front_sidedef].sector;
+        if (line_def.back_sidedef >= 0 && line_def.back_sidedef < (int)map->sidedefs.size())
+            back = map->sidedefs[line_def.back_sidedef].sector;
+        if (front < 0 || front >= sector_count) continue;
+
+        if (kind == EDGE_TELEPORT && line_def.sector_tag != 0)
+        {
+            for (int sectori : sectors_by_tag[line_def.sector_tag])
+                edges.push_back({front, {sectori, i, EDGE_TELEPORT}});
+            kind = 0; // Walking over the line itself is free
+        }
+
+        if (back < 0 || back >= sector_count || back == front) continue;
+        edges.push_back({front, {back, i, (uint8_t)(kind | tagged_kind[back])}});
+        edges.push_back({back, {front, i, (uint8_t)(kind | tagged_kind[front])}});
+    }
+
+    map->sector_edge_offsets.assign(sector_count + 1, 0);
+    for (const auto& edge : edges)
+        map->sector_edge_offsets[edge.from + 1]++;
+    for (int i = 0; i < sector_count; ++i)
+        map->sector_edge_offsets[i + 1] += map->sector_edge_offsets[i];
+
+    std::vector<int> fill = map->sector_edge_offsets;
+    map->sector_edges.resize(edges.size());
+    for (const auto& edge : edges)
+        map->sector_edges[fill[edge.from]++] = edge.edge;
+}
+
+// Display geometry is in view space (Y flipped), grids are in map space
+static map_grid_entry_t view_points_entry(int item, const vec2_t* points, int count)
+{
+    vec2_t bbmin = points[0];
+    vec2_t bbmax = points[0];
+    for (int i = 1; i < count; ++i)
+    {
+        bbmin = vec2_t::min(bbmin, points[i]);
+        bbmax = vec2_t::max(bbmax, points[i]);
+    }
+    return {
+        item,
+        (int)std::floor(bbmin.x), (int)std::floor(-bbmax.y),
+        (int)std::ceil(bbmax.x), (int)std::ceil(-bbmin.y)
+    };
+}
+
+
+void build_draw_grids(map_t* map)
+{
+    std::vector<map_grid_entry_t> entries;
+
+    entries.clear();
+    for (int i = 0, len = (int)map->linedefs.size(); i < len; ++i)
+    {
+        const auto& v1 = map->vertexes[map->linedefs[i].start_vertex];
+        const auto& v2 = map->vertexes[map->linedefs[i].end_vertex];
+        entries.push_back({i, std::min(v1.x, v2.x), std::min(v1.y, v2.y), std::max(v1.x, v2.x), std::max(v1.y, v2.y)});
+    }
+    build_grid(map->linedef_grid, map->bb[0], map->bb[1], map->bb[2], map->bb[3], entries);
+
+    entries.clear();
+    for (int i = 0, len = (int)map->sectors.size(); i < len; ++i)
+    {
+        const auto& verts = map->sectors[i].triangle_vertices;
+        if (verts.empty()) continue;
+        entries.push_back(view_points_entry(i, verts.data(), (int)verts.size()));
+    }
+    build_grid(map->sector_grid, map->bb[0], map->bb[1], map->bb[2], map->bb[3], entries);
+
+    entries.clear();
+    for (int i = 0, len = (int)map->arrows.size(); i < len; ++i)
+    {
+        vec2_t points[2] = {map->arrows[i].from, map->arrows[i].to};
+        entries.push_back(view_points_entry(i, points, 2));
+    }
+    build_grid(map->arrow_grid, map->bb[0], map->bb[1], map->bb[2], map->bb[3], entries);
+
+    entries.clear();
+    for (int i = 0, len = (int)map->things.size(); i < len; ++i)
+    {
+        const auto& thing = map->things[i];
+        entries.push_back({i, thing.x, thing.y, thing.x, thing.y});
+    }
+    build_grid(map->thing_grid, map->bb[0], map->bb[1], map->bb[2], map->bb[3], entries);
+}
+
+
+bool init_maps(game_t& game, const std::map<std::string, uint64_t>* previous_hashes, bool headless)
 {
     std::vector<game_wad_t> wad_list;
 
@@ -588,7 +840,7 @@ bool init_maps(game_t& game)
         for (std::string &pwad : game.required_wads)
         {
             // Do not attempt to load non-WADs! (e.g. STRAIN.DEH)
-            if (onut::toLower(pwad.substr(pwad.size() - 4)) == ".wad")
+            if (to_lower(pwad.substr(pwad.size() - 4)) == ".wad")
                 wad_list.push_back(pwad);
         }
     }
@@ -628,6 +880,11 @@ bool init_maps(game_t& game)
 
     }
 
+    // Which things are locations changes the check counts, so it's part of every level's hash
+    uint64_t location_types_hash = hash_bytes(nullptr, 0);
+    for (const auto& kv : game.location_doom_types)
+        location_types_hash = hash_bytes(&kv.first, sizeof(kv.first), location_types_hash);
+
     for (auto& episode : game.episodes)
     {
         for (auto& level : episode)
@@ -692,9 +949,34 @@ bool init_maps(game_t& game)
                     mt.flags |= THING_FLAG_MP_ONLY;
             }
 
+            // Count total thing count (Consider UV difficulty)
+            for (const auto& thing : map->things)
+                if (thing.flags & THING_FLAG_HARD)
+                    game.total_doom_types[thing.type]++;
+
+            map->hash = location_types_hash;
+            map->hash = hash_lump(map->things, map->hash);
+            map->hash = hash_lump(map->linedefs, map->hash);
+            map->hash = hash_lump(map->sidedefs, map->hash);
+            map->hash = hash_lump(map->vertexes, map->hash);
+            map->hash = hash_lump(map->map_sectors, map->hash);
+            map->hash = hash_lump(map->map_subsectors, map->hash);
+            map->hash = hash_lump(map->map_nodes, map->hash);
+            map->hash = hash_lump(map->map_segs, map->hash);
+            if (previous_hashes)
+            {
+                auto it = previous_hashes->find(level.lump_name);
+                if (it != previous_hashes->end() && it->second == map->hash)
+                {
+                    map->unchanged = true;
+                    continue;
+                }
+            }
+
             map->sectors.resize(map->map_sectors.size());
             map->subsectors.resize(map->map_subsectors.size());
             map->nodes.resize(map->map_nodes.size());
+            map->node_bboxes.resize(map->map_nodes.size());
             for (int j = 0, lenj = (int)map->map_nodes.size(); j < lenj; ++j)
             {
                 map->nodes[j].x = (int16_t)map->map_nodes[j].x << 16;
@@ -714,7 +996,7 @@ bool init_maps(game_t& game)
                         map->nodes[j].children[jj] |= NF_SUBSECTOR;
                     }
                     for (int k = 0; k < 4; ++k)
-                        map->nodes[j].bbox[jj][k] = (int16_t)map->map_nodes[j].bbox[jj][k] << 16;
+                        map->node_bboxes[j].bbox[jj][k] = (int16_t)map->map_nodes[j].bbox[jj][k] << 16;
                 }
             }
 
@@ -748,8 +1030,9 @@ bool init_maps(game_t& game)
                 map->bb[3] = std::max(map->bb[3], map->vertexes[v].y);
             }
 
-            // Triangulate
-            triangulate_map(map);
+            // Triangulate. Without triangles, no arrows get made below either.
+            if (!headless)
+                triangulate_map(map);
 
             // Create arrows
             for (int j = 0; j < (int)map->linedefs.size(); ++j)
@@ -771,16 +1054,16 @@ bool init_maps(game_t& game)
                         const auto& map_sector = map->map_sectors[k];
                         if (map_sector.tag == line_def.sector_tag)
                         {
-                            Vector2 bbmin, bbmax;
+                            vec2_t bbmin, bbmax;
                             const auto& sector = map->sectors[k];
                             if (sector.triangle_vertices.empty()) continue;
                             bbmin = sector.triangle_vertices[0];
                             bbmax = bbmin;
                             for (int l = 1; l < (int)sector.triangle_vertices.size(); ++l)
                             {
-                                Vector2 pt = sector.triangle_vertices[l];
-                                bbmin = onut::min(bbmin, pt);
-                                bbmax = onut::max(bbmax, pt);
+                                vec2_t pt = sector.triangle_vertices[l];
+                                bbmin = vec2_t::min(bbmin, pt);
+                                bbmax = vec2_t::max(bbmax, pt);
                             }
                             arrow.to = (bbmin + bbmax) * 0.5f;
                             map->arrows.push_back(arrow);
@@ -789,33 +1072,38 @@ bool init_maps(game_t& game)
                 }
             }
 
+            build_sector_graph(map);
+
             // Count checks
+            std::vector<map_grid_entry_t> location_entries;
             map->check_count = 0;
             for (int j = 0, len = (int)map->things.size(); j < len; ++j)
             {
                 const auto& thing = map->things[j];
-
-                // Count total thing count (Consider UV difficulty)
-                if (thing.flags & THING_FLAG_HARD)
-                    game.total_doom_types[thing.type]++;
-
                 if (thing.flags & THING_FLAG_MP_ONLY) continue; // Thing is not in single player
-                auto it = game.location_doom_types.find(thing.type);
-                if (it == game.location_doom_types.end()) continue;
+                if (!game.doom_types[thing.type].is_location()) continue;
                 map->check_count++;
+                location_entries.push_back({j, thing.x, thing.y, thing.x, thing.y});
             }
+            build_grid(map->location_grid, map->bb[0], map->bb[1], map->bb[2], map->bb[3], location_entries);
+
+            if (!headless)
+                build_draw_grids(map);
         }
     }
 
-    // Load palette
-    auto pal = load_lump(wad_list, "PLAYPAL");
-
-    // Load sprites for item requirements
-    for (auto& item_requirement : game.item_requirements)
+    if (!headless)
     {
-        if (item_requirement.sprite != "")
+        // Load palette
+        auto pal = load_lump(wad_list, "PLAYPAL");
+
+        // Load sprites for item requirements
+        for (auto& item_requirement : game.item_requirements)
         {
-            item_requirement.icon = load_sprite(wad_list, item_requirement.sprite.c_str(), pal.data());
+            if (item_requirement.sprite != "")
+            {
+                load_sprite(wad_list, item_requirement.sprite.c_str(), pal.data(), item_requirement);
+            }
         }
     }
 
@@ -837,3 +1125,103 @@ int sector_at(int x, int y, map_t* map)
     auto subsector = point_in_subsector(x, y, map);
     return subsector->sector;
 }
+
+
+std::vector<int> flood_fill_sectors(const map_t* map, int start_sector, uint8_t stop_kinds)
+{
+    std::vector<int> filled;
+    int sector_count = (int)map->sector_edge_offsets.size() - 1;
+    if (start_sector < 0 || start_sector >= sector_count)
+        return filled;
+
+    std::vector<bool> visited(sector_count, false);
+    visited[start_sector] = true;
+    filled.push_back(start_sector);
+
+    // "filled" doubles as the queue
+    for (int next = 0; next < (int)filled.size(); ++next)
+    {
+        int sectori = filled[next];
+        for (int e = map->sector_edge_offsets[sectori]; e < map->sector_edge_offsets[sectori + 1]; ++e)
+        {
+            const auto& edge = map->sector_edges[e];
+            if ((edge.kind & stop_kinds) || visited[edge.sector]) continue;
+            visited[edge.sector] = true;
+            filled.push_back(edge.sector);
+        }
+    }
+    return filled;
+}
+
+
+void build_grid(map_grid_t& grid, int x1, int y1, int x2, int y2, const std::vector<map_grid_entry_t>& entries)
+{
+    grid.x = x1;
+    grid.y = y1;
+    grid.cols = (x2 - x1) / grid.cell_size + 1;
+    grid.rows = (y2 - y1) / grid.cell_size + 1;
+
+    auto cell_range = [&grid](const map_grid_entry_t& entry, int& cx1, int& cy1, int& cx2, int& cy2)
+    {
+        // Anything outside of the map's bounds goes in the border cells
+        cx1 = std::clamp((entry.x1 - grid.x) / grid.cell_size, 0, grid.cols - 1);
+        cy1 = std::clamp((entry.y1 - grid.y) / grid.cell_size, 0, grid.rows - 1);
+        cx2 = std::clamp((entry.x2 - grid.x) / grid.cell_size, 0, grid.cols - 1);
+        cy2 = std::clamp((entry.y2 - grid.y) / grid.cell_size, 0, grid.rows - 1);
+    };
+
+    // Count, then fill. Entries are visited in order so each cell's items stay sorted.
+    grid.cell_offsets.assign(grid.cols * grid.rows + 1, 0);
+    for (const auto& entry : entries)
+    {
+        int cx1, cy1, cx2, cy2;
+        cell_range(entry, cx1, cy1, cx2, cy2);
+        for (int cy = cy1; cy <= cy2; ++cy)
+            for (int cx = cx1; cx <= cx2; ++cx)
+                grid.cell_offsets[cy * grid.cols + cx + 1]++;
+    }
+    for (int c = 0; c < grid.cols * grid.rows; ++c)
+        grid.cell_offsets[c + 1] += grid.cell_offsets[c];
+
+    std::vector<int> fill(grid.cell_offsets.begin(), grid.cell_offsets.end() - 1);
+    grid.items.resize(grid.cell_offsets.back());
+    for (const auto& entry : entries)
+    {
+        int cx1, cy1, cx2, cy2;
+        cell_range(entry, cx1, cy1, cx2, cy2);
+        for (int cy = cy1; cy <= cy2; ++cy)
+            for (int cx = cx1; cx <= cx2; ++cx)
+                grid.items[fill[cy * grid.cols + cx]++] = entry.item;
+    }
+}
+
+
+// Gathers every item in the cells touching the given area (map coordinates).
+// Items come out sorted and without duplicates; callers still need to test them precisely.
+void query_grid(const map_grid_t& grid, int x1, int y1, int x2, int y2, std::vector<int>& items)
+{
+    items.clear();
+    if (grid.cols <= 0 || grid.rows <= 0)
+        return;
+
+    int cx1 = std::clamp((x1 - grid.x) / grid.cell_size, 0, grid.cols - 1);
+    int cy1 = std::clamp((y1 - grid.y) / grid.cell_size, 0, grid.rows - 1);
+    int cx2 = std::clamp((x2 - grid.x) / grid.cell_size, 0, grid.cols - 1);
+    int cy2 = std::clamp((y2 - grid.y) / grid.cell_size, 0, grid.rows - 1);
+
+    for (int cy = cy1; cy <= cy2; ++cy)
+    {
+        for (int cx = cx1; cx <= cx2; ++cx)
+        {
+            int c = cy * grid.cols + cx;
+            items.insert(items.end(), grid.items.begin() + grid.cell_offsets[c], grid.items.begin() + grid.cell_offsets[c + 1]);
+        }
+    }
+
+    // Only need to merge when looking at more than one cell
+    if (cx1 != cx2 || cy1 != cy2)
+    {
+        std::sort(items.begin(), items.end());
+        items.erase(std::unique(items.begin(), items.end()), items.end());
+    }
+}
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <cinttypes>
+#include <map>
+#include <string>
 #include <vector>
-#include <onut/Color.h>
-#include <onut/Vector2.h>
+
+#include "maths.hpp"
 
 
 struct map_thing_t
@@ -103,21 +105,28 @@ struct seg_t
 
 struct sector_t
 {
-    std::vector<Vector2> triangle_vertices;
+    std::vector<vec2_t> triangle_vertices;
 };
 
 
+// Hot BSP data: only what's needed to walk down the tree.
 struct node_t
 {
     int x;
     int y;
     int dx;
     int dy;
-    int bbox[2][4];
     int children[2];
 };
 
 
+// Cold BSP data, kept apart so it doesn't pollute the cache while walking nodes.
+struct node_bbox_t
+{
+    int bbox[2][4];
+};
+
+
 struct subsector_t
 {
     int sector;
@@ -138,13 +147,50 @@ enum arrowtype_t
 
 struct arrow_t
 {
-    Vector2 from;
-    Vector2 to;
-    Color color;
+    vec2_t from;
+    vec2_t to;
+    color_t color;
     arrowtype_t type;
 };
 
 
+// What has to be crossed to go from one sector to its neighbour (bit flags).
+// Plain two-sided lines have no bits set.
+enum sector_edge_kind_t
+{
+    EDGE_DOOR        = 0x01,
+    EDGE_LOCKED_DOOR = 0x02,
+    EDGE_LIFT        = 0x04,
+    EDGE_TELEPORT    = 0x08,
+    EDGE_OTHER       = 0x10, // Any other special (stairs, crushers, exits...)
+};
+
+struct sector_edge_t
+{
+    int sector; // Neighbouring sector
+    int linedef; // Line shared with (or teleporting to) the neighbour
+    uint8_t kind; // sector_edge_kind_t flags
+};
+
+
+// Uniform grid over map space (map coordinates, y up) for quick spatial lookups.
+// Items of cell c are items[cell_offsets[c]] up to items[cell_offsets[c + 1]], in ascending order.
+struct map_grid_t
+{
+    int x = 0, y = 0; // Bottom left corner
+    int cell_size = 256;
+    int cols = 0, rows = 0;
+    std::vector<int> cell_offsets;
+    std::vector<int> items;
+};
+
+struct map_grid_entry_t
+{
+    int item;
+    int x1, y1, x2, y2; // Area covered by the item, inclusive
+};
+
+
 struct map_t
 {
     std::vector<map_thing_t>        things;
@@ -158,15 +204,36 @@ struct map_t
     std::vector<seg_t>              segs;
     std::vector<subsector_t>        subsectors;
     std::vector<node_t>             nodes;
+    std::vector<node_bbox_t>        node_bboxes;
     std::vector<sector_t>           sectors;
     int16_t bb[4];
     std::vector<arrow_t>            arrows;
     int check_count;
+    uint64_t hash = 0; // Of the lumps it was built from, after tweaks, to spot changes on reload
+    bool unchanged = false; // Reloaded with the same hash, so the geometry wasn't rebuilt
+
+    // Sector adjacency graph, in CSR form: edges leaving sector i are
+    // sector_edges[sector_edge_offsets[i]] up to sector_edges[sector_edge_offsets[i + 1]]
+    std::vector<int>                sector_edge_offsets;
+    std::vector<sector_edge_t>      sector_edges;
+
+    map_grid_t                      location_grid; // Things that are locations
+
+    // For culling what's drawn to what's in view
+    map_grid_t                      linedef_grid;
+    map_grid_t                      sector_grid;
+    map_grid_t                      arrow_grid;
+    map_grid_t                      thing_grid;
 };
 
 
 struct game_t;
 
-bool init_maps(game_t& game);
+// 'headless' skips everything only the editor draws: triangles, arrows, draw grids and sprites
+bool init_maps(game_t& game, const std::map<std::string, uint64_t>* previous_hashes = nullptr, bool headless = false);
 int sector_at(int x, int y, map_t* map);
 subsector_t* point_in_subsector(int x, int y, map_t* map);
+void locate_points(const map_t* map, const int* xs, const int* ys, int count, int* subsectors);
+std::vector<int> flood_fill_sectors(const map_t* map, int start_sector, uint8_t stop_kinds);
+void build_grid(map_grid_t& grid, int x1, int y1, int x2, int y2, const std::vector<map_grid_entry_t>& entries);
+void query_grid(const map_grid_t& grid, int x1, int y1, int x2, int y2, std::vector<int>& items);
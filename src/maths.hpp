@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+// The little vector math the core does, so it doesn't need onut's.
+// Laid out like onut's Vector2 and Color, the editor converts them to draw.
+
+struct vec2_t
+{
+    float x = 0.0f;
+    float y = 0.0f;
+
+    vec2_t() = default;
+    vec2_t(float x, float y) : x(x), y(y) {}
+
+    vec2_t operator+(const vec2_t& v) const { return {x + v.x, y + v.y}; }
+    vec2_t operator-(const vec2_t& v) const { return {x - v.x, y - v.y}; }
+    vec2_t operator-() const { return {-x, -y}; }
+    vec2_t operator*(float s) const { return {x * s, y * s}; }
+    vec2_t operator/(float s) const { return {x / s, y / s}; }
+    bool operator==(const vec2_t& v) const { return x == v.x && y == v.y; }
+
+    float dot(const vec2_t& v) const { return x * v.x + y * v.y; }
+    float cross(const vec2_t& v) const { return x * v.y - y * v.x; } // z of the 3D cross product
+    float length() const { return std::sqrt(x * x + y * y); }
+
+    vec2_t normalized() const
+    {
+        float len = length();
+        return len > 0.0f ? *this / len : *this;
+    }
+
+    static float distance(const vec2_t& a, const vec2_t& b) { return (b - a).length(); }
+    static vec2_t min(const vec2_t& a, const vec2_t& b) { return {std::min(a.x, b.x), std::min(a.y, b.y)}; }
+    static vec2_t max(const vec2_t& a, const vec2_t& b) { return {std::max(a.x, b.x), std::max(a.y, b.y)}; }
+};
+
+
+struct color_t
+{
+    float r = 0.0f;
+    float g = 0.0f;
+    float b = 0.0f;
+    float a = 1.0f;
+
+    color_t() = default;
+    color_t(float r, float g, float b, float a = 1.0f) : r(r), g(g), b(b), a(a) {}
+
+    bool operator==(const color_t& c) const { return r == c.r && g == c.g && b == c.b && a == c.a; }
+};
@@ -1,47 +1,47 @@
-#include <imgui/imgui.h>
+#pragma once
 
-#include <forward_list>
+#include <string>
+#include <vector>
+#include <stdio.h>
 
+// Messages for the user. The editor draws them (message_ui.hpp), the command line tool prints them.
+// Nothing in here needs a window.
 class OnScreenMessages
 {
+public:
+    enum class Kind
+    {
+        Normal,
+        Error,
+        Warning,
+        Notice
+    };
+
     struct Message
     {
-        ImVec4 bgcolor;
-        ImS32 ttl;
+        Kind kind;
         std::string text;
     };
-    std::forward_list<Message> messages;
+
+private:
+    std::vector<Message> pending; // Until the editor takes them to show
+    bool to_console = false; // No window to show them in
+    std::vector<std::string>* captured = nullptr; // Console messages are also kept here while set
 
     OnScreenMessages() {}
 
-    void DoRender()
+    void DoAdd(const std::string text, Kind kind)
     {
-        ImDrawList* fg = ImGui::GetForegroundDrawList();
-        ImGuiViewport* vp = ImGui::GetMainViewport();
-
-        float x = 8.0f;
-        float y = vp->Pos.y + vp->Size.y;
-        for (Message &message : messages)
+        if (to_console)
         {
-            float alpha = (--message.ttl / 30.0f);
-            ImColor text_color(1.0f, 1.0f, 1.0f, alpha);
-            ImVec2 text_bounds = ImGui::CalcTextSize(message.text.c_str());
-
-            y -= (text_bounds.y + 6.0f);
-            message.bgcolor.w = alpha;
-            fg->AddRectFilled({x - 4.0f, y - 2.0f}, {x + text_bounds.x + 4.0f, y + text_bounds.y + 2.0f}, ImGui::ColorConvertFloat4ToU32(message.bgcolor), 2.0f, 0);
-            fg->AddText({x, y}, text_color, &message.text.front(), (&message.text.back() + 1));
+            const char* console_prefix = (kind == Kind::Error) ? "error: " : (kind == Kind::Warning) ? "warning: " : "";
+            fprintf(*console_prefix ? stderr : stdout, "%s%s\n", console_prefix, text.c_str());
+            if (captured)
+                captured->push_back(console_prefix + text);
+            return;
         }
-        messages.remove_if([](Message& m){ return m.ttl <= 0; });
-    }
 
-    void DoAdd(const std::string text, ImVec4 bgcolor)
-    {
-        Message new_msg;
-        new_msg.text = text;
-        new_msg.ttl = 300;
-        new_msg.bgcolor = bgcolor;
-        messages.push_front(new_msg);
+        pending.push_back({kind, text});
     }
 
     static OnScreenMessages& Get()
@@ -51,29 +51,44 @@ class OnScreenMessages
     }
 
 public:
-    static void Render()
+    // Messages added since the last call, oldest first
+    static std::vector<Message> TakePending()
+    {
+        std::vector<Message> messages;
+        messages.swap(OnScreenMessages::Get().pending);
+        return messages;
+    }
+
+    // Prints messages as they come instead, for the command line tool
+    static void UseConsole()
+    {
+        OnScreenMessages::Get().to_console = true;
+    }
+
+    // Also keeps console messages in 'lines' until called again with nullptr, e.g. to send them back to a daemon client
+    static void Capture(std::vector<std::string>* lines)
     {
-        OnScreenMessages::Get().DoRender();
+        OnScreenMessages::Get().captured = lines;
     }
 
-    static void Add(const std::string text, ImVec4 bgcolor = ImVec4(0.14f, 0.14f, 0.14f, 1.0f))
+    static void Add(const std::string text)
     {
-        OnScreenMessages::Get().DoAdd(text, bgcolor);
+        OnScreenMessages::Get().DoAdd(text, Kind::Normal);
     }
 
     static void AddError(const std::string text)
     {
-        OnScreenMessages::Get().DoAdd(text, ImColor(0.3f, 0.0f, 0.0f));
+        OnScreenMessages::Get().DoAdd(text, Kind::Error);
     }
 
     static void AddWarning(const std::string text)
     {
-        OnScreenMessages::Get().DoAdd(text, ImColor(0.3f, 0.3f, 0.0f));
+        OnScreenMessages::Get().DoAdd(text, Kind::Warning);
     }
 
     static void AddNotice(const std::string text)
     {
-        OnScreenMessages::Get().DoAdd(text, ImColor(0.0f, 0.3f, 0.0f));
+        OnScreenMessages::Get().DoAdd(text, Kind::Notice);
     }
 
     OnScreenMessages(OnScreenMessages const&) = delete;
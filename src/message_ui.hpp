@@ -0,0 +1,61 @@
+#pragma once
+
+#include <imgui/imgui.h>
+
+#include <forward_list>
+
+#include "message.hpp"
+
+// Draws OnScreenMessages in the editor, newest at the bottom, each fading out after a few seconds
+class OnScreenMessagesUI
+{
+    struct Message
+    {
+        ImVec4 bgcolor;
+        ImS32 ttl;
+        std::string text;
+    };
+
+    static ImVec4 GetColor(OnScreenMessages::Kind kind)
+    {
+        switch (kind)
+        {
+        case OnScreenMessages::Kind::Error: return ImColor(0.3f, 0.0f, 0.0f);
+        case OnScreenMessages::Kind::Warning: return ImColor(0.3f, 0.3f, 0.0f);
+        case OnScreenMessages::Kind::Notice: return ImColor(0.0f, 0.3f, 0.0f);
+        default: return ImVec4(0.14f, 0.14f, 0.14f, 1.0f);
+        }
+    }
+
+public:
+    static void Render()
+    {
+        static std::forward_list<Message> messages;
+        for (auto& pending : OnScreenMessages::TakePending())
+        {
+            Message new_msg;
+            new_msg.text = std::move(pending.text);
+            new_msg.ttl = 300;
+            new_msg.bgcolor = GetColor(pending.kind);
+            messages.push_front(new_msg);
+        }
+
+        ImDrawList* fg = ImGui::GetForegroundDrawList();
+        ImGuiViewport* vp = ImGui::GetMainViewport();
+
+        float x = 8.0f;
+        float y = vp->Pos.y + vp->Size.y;
+        for (Message &message : messages)
+        {
+            float alpha = (--message.ttl / 30.0f);
+            ImColor text_color(1.0f, 1.0f, 1.0f, alpha);
+            ImVec2 text_bounds = ImGui::CalcTextSize(message.text.c_str());
+
+            y -= (text_bounds.y + 6.0f);
+            message.bgcolor.w = alpha;
+            fg->AddRectFilled({x - 4.0f, y - 2.0f}, {x + text_bounds.x + 4.0f, y + text_bounds.y + 2.0f}, ImGui::ColorConvertFloat4ToU32(message.bgcolor), 2.0f, 0);
+            fg->AddText({x, y}, text_color, &message.text.front(), (&message.text.back() + 1));
+        }
+        messages.remove_if([](Message& m){ return m.ttl <= 0; });
+    }
+};
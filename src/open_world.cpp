@@ -16,7 +16,15 @@
 
 #include <imgui/imgui.h>
 
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <set>
 
@@ -24,8 +32,14 @@
 #include "generate.h"
 #include "defs.h"
 #include "data.h"
+#include "data_bin.h"
+#include "data_load.h"
 
 #include "message.hpp"
+#include "message_ui.hpp"
+#include "json_writer.hpp"
+#include "json_reader.hpp"
+#include "util.hpp"
 
 
 enum class state_t
@@ -61,8 +75,6 @@ enum class tool_t : int
 };
 
 
-#define RULES_W 1024
-#define RULES_H 400
 #define RULE_CONNECTION_OFFSET 64.0f
 #define BIG_DOOR_W 128
 #define BIG_DOOR_H 128
@@ -71,18 +83,23 @@ enum class tool_t : int
 
 
 
+// The core has its own math types, onut's are only for drawing
+static Vector2 to_vector2(const vec2_t& v) { return Vector2(v.x, v.y); }
+static vec2_t to_vec2(const Vector2& v) { return vec2_t(v.x, v.y); }
+static Color to_color(const color_t& c) { return Color(c.r, c.g, c.b, c.a); }
+
 
 static region_t world_region = {
     "Hub",
     {},
-    Color(0.6f, 0.6f, 0.6f, 1.0f),
+    color_t(0.6f, 0.6f, 0.6f, 1.0f),
     {}
 };
 
 static region_t exit_region = {
     "Exit",
     {},
-    Color(0.6f, 0.6f, 0.6f, 1.0f),
+    color_t(0.6f, 0.6f, 0.6f, 1.0f),
     {}
 };
 
@@ -95,7 +112,7 @@ static state_t state = state_t::idle;
 static tool_t tool = tool_t::locations;
 static Vector2 mouse_pos;
 static Vector2 mouse_pos_on_down;
-static Vector2 cam_pos_on_down;
+static vec2_t cam_pos_on_down;
 static bb_t bb_on_down;
 static bb_t bb_new;
 static map_state_t* map_state = nullptr;
@@ -108,6 +125,7 @@ static OTextureRef ap_region_override_icon;
 static OTextureRef ap_check_sanity_icon;
 static OTextureRef ap_player_start_icon;
 static OTextureRef ap_wing_icon;
+static std::map<std::string, std::vector<OTextureRef>> item_icons; // By game, one per item requirement
 static int mouse_hover_bb = -1;
 static int mouse_hover_sector = -1;
 static int moving_edge = -1;
@@ -132,6 +150,99 @@ static int set_rule_connection = -1;
 //static int mouse_hover_access = -1;
 static int mouse_hover_location = -1;
 static uint8_t disable_arrows = 0x00;
+static uint8_t flood_fill_stop = EDGE_DOOR | EDGE_LOCKED_DOOR | EDGE_LIFT | EDGE_TELEPORT;
+
+
+struct rule_segment_t
+{
+    int connection;
+    Vector2 from, to;
+    Vector2 dir, right;
+};
+
+// Rule boxes and connection arrows of the active level. Rebuilt only after rules move or connections change.
+struct rules_cache_t
+{
+    const map_state_t* state = nullptr;
+    int region_count = 0;
+    std::vector<Vector2> centers; // Per slot
+    std::vector<rule_segment_t> segments;
+    std::vector<int> segment_offsets; // First segment of each slot, plus the end
+    map_grid_t grid; // Over segments, in view space
+};
+static rules_cache_t rules_cache;
+
+
+struct save_level_job_t
+{
+    int ep = 0;
+    int lvl = 0;
+    int version = 0; // save_version of the copied state
+    std::string lump_name;
+    std::unique_ptr<map_state_t> state; // Copy to encode, when the cached fragments are out of date
+    bool encoded = false;
+    std::shared_ptr<const std::string> fragment;
+    std::shared_ptr<const std::string> bin_fragment;
+};
+
+// One save of a game, handed to the save thread and back with the results
+struct save_job_t
+{
+    std::string short_name;
+    bool autosave = false;
+    std::vector<save_level_job_t> levels;
+    std::string error;
+    std::string warning;
+    std::string message;
+    uint64_t json_hash = 0; // Of the .data.json written
+    uint64_t json_size = 0;
+};
+
+static std::thread save_thread;
+static std::mutex save_mutex; // Guards everything below
+static std::condition_variable save_cv;
+static std::deque<save_job_t> save_queue;
+static std::vector<save_job_t> save_results;
+static bool save_thread_quit = false;
+
+// A game being loaded by its own thread. Only the results come back to the main thread.
+struct game_load_job_t
+{
+    std::string short_name;
+    std::string path;
+    long start_time = 0;
+    game_t game;
+    bool succeeded = false;
+    std::vector<std::string> errors;
+    bool reload = false; // Of a game that's already loaded
+    std::map<std::string, uint64_t> previous_hashes; // Level hashes by lump name, for reloads
+};
+
+static std::map<std::string, std::thread> load_threads; // By short name
+static std::mutex load_mutex; // Guards load_results
+static std::vector<std::unique_ptr<game_load_job_t>> load_results;
+
+// Files a loaded game was built from, checked for changes about once a second
+struct watched_file_t
+{
+    std::string short_name;
+    bool is_data = false; // The .data.json, otherwise the .game.json or a wad
+    std::filesystem::file_time_type time;
+    uintmax_t size = 0;
+};
+
+static std::map<std::string, watched_file_t> watched_files; // By path
+static std::chrono::steady_clock::time_point last_watch_poll = std::chrono::steady_clock::now();
+static std::map<std::string, int> saves_in_flight; // By short name, their .data.json is ours while it changes
+
+static int autosave_minutes = 0; // 0 is off
+static std::chrono::steady_clock::time_point last_autosave = std::chrono::steady_clock::now();
+
+
+void invalidate_rules_cache()
+{
+    rules_cache.state = nullptr;
+}
 
 
 void update_window_title(std::string override)
@@ -183,301 +294,875 @@ const char* ERROR_STR = "ERROR";
 const char* get_doom_type_name(const level_index_t& idx, int doom_type)
 {
     auto game = get_game(idx);
-    auto it = game->location_doom_types.find(doom_type);
-    if (it == game->location_doom_types.end()) return ERROR_STR;
-    return it->second.c_str();
+    const auto& name = game->doom_types.location_name(doom_type);
+    if (name.empty()) return ERROR_STR;
+    return name.c_str();
 }
 
 
-Json::Value serialize_rules(const rule_region_t& rules)
+// Version 2 of the .data.json leaves out anything that is at its default value
+static bool is_default_rules(const rule_region_t& rules)
 {
-    Json::Value json;
-
-    json["x"] = rules.x;
-    json["y"] = rules.y;
+    return rules.connections.empty() && rules.x == 0 && rules.y == 0;
+}
 
-    Json::Value connections_json(Json::arrayValue);
-    for (const auto& connection : rules.connections)
-    {
-        Json::Value connection_json;
 
-        connection_json["target_region"] = connection.target_region;
+void write_rules(StyledJsonWriter& writer, const rule_region_t& rules)
+{
+    std::vector<std::string> values;
 
+    writer.BeginObject();
+    if (!rules.connections.empty())
+    {
+        writer.Key("connections");
+        writer.BeginArray();
+        for (const auto& connection : rules.connections)
         {
-            Json::Value requirements_json(Json::arrayValue);
-            for (auto requirement : connection.requirements_or)
+            writer.Element();
+            writer.BeginObject();
+
+            if (!connection.requirements_and.empty())
             {
-                requirements_json.append(requirement);
+                values.clear();
+                for (auto requirement : connection.requirements_and)
+                    values.push_back(StyledJsonWriter::FormatInt(requirement));
+                writer.Key("requirements_and");
+                writer.ScalarArray(values);
             }
-            connection_json["requirements_or"] = requirements_json;
-        }
 
-        {
-            Json::Value requirements_json(Json::arrayValue);
-            for (auto requirement : connection.requirements_and)
+            if (!connection.requirements_or.empty())
             {
-                requirements_json.append(requirement);
+                values.clear();
+                for (auto requirement : connection.requirements_or)
+                    values.push_back(StyledJsonWriter::FormatInt(requirement));
+                writer.Key("requirements_or");
+                writer.ScalarArray(values);
             }
-            connection_json["requirements_and"] = requirements_json;
-        }
 
-        connections_json.append(connection_json);
+            writer.Key("target_region");
+            writer.Value(StyledJsonWriter::FormatInt(connection.target_region));
+            writer.EndObject();
+        }
+        writer.EndArray();
     }
-    json["connections"] = connections_json;
-
-    return json;
+    if (rules.x != 0)
+    {
+        writer.Key("x");
+        writer.Value(StyledJsonWriter::FormatInt(rules.x));
+    }
+    if (rules.y != 0)
+    {
+        writer.Key("y");
+        writer.Value(StyledJsonWriter::FormatInt(rules.y));
+    }
+    writer.EndObject();
 }
 
 
-rule_region_t deserialize_rules(const Json::Value& json)
+// One level's entry in the .data.json "maps" array
+void write_level(StyledJsonWriter& writer, const map_state_t& level_state, const std::string& lump_name)
 {
-    rule_region_t rules;
+    auto state = &level_state;
+    std::vector<std::string> values;
+
+    writer.BeginObject();
 
-    rules.x = json.get("x", 0).asInt();
-    rules.y = json.get("y", 0).asInt();
+    writer.Key("_lump");
+    writer.Value(StyledJsonWriter::FormatString(lump_name));
 
-    const auto& connections_json = json["connections"];
-    for (const auto& connection_json : connections_json)
+    if (!state->accesses.empty())
     {
-        rule_connection_t connection;
+        values.clear();
+        for (auto access : state->accesses)
+            values.push_back(StyledJsonWriter::FormatInt(access));
+        writer.Key("accesses");
+        writer.ScalarArray(values);
+    }
 
-        connection.target_region = connection_json.get("target_region", -1).asInt();
-        
+    if (!state->bbs.empty())
+    {
+        writer.Key("bbs");
+        writer.BeginArray();
+        for (const auto& bb : state->bbs)
         {
-            const auto& requirements_json = connection_json["requirements_or"];
-            for (const auto& requirement_json : requirements_json)
-            {
-                connection.requirements_or.push_back(requirement_json.asInt());
-            }
+            writer.Element();
+            writer.ScalarArray({
+                StyledJsonWriter::FormatInt(bb.x1),
+                StyledJsonWriter::FormatInt(bb.y1),
+                StyledJsonWriter::FormatInt(bb.x2),
+                StyledJsonWriter::FormatInt(bb.y2),
+                StyledJsonWriter::FormatInt(bb.region)
+            });
+        }
+        writer.EndArray();
+    }
+
+    if (!is_default_rules(state->exit_rules))
+    {
+        writer.Key("exit_rules");
+        write_rules(writer, state->exit_rules);
+    }
+
+    // Locations left as they come from the map are recreated on load
+    bool has_locations = false;
+    for (const auto& kv : state->locations)
+    {
+        const auto& location = kv.second;
+        if (!location.check_sanity && !location.death_logic && !location.unreachable && location.name.empty() && location.description.empty())
+            continue;
+
+        if (!has_locations)
+        {
+            writer.Key("locations");
+            writer.BeginArray();
+            has_locations = true;
+        }
+        writer.Element();
+        writer.BeginObject();
+        if (location.check_sanity)
+        {
+            writer.Key("check_sanity");
+            writer.Value(StyledJsonWriter::FormatBool(true));
         }
+        if (location.death_logic)
         {
-            const auto& requirements_json = connection_json["requirements_and"];
-            for (const auto& requirement_json : requirements_json)
+            writer.Key("death_logic");
+            writer.Value(StyledJsonWriter::FormatBool(true));
+        }
+        if (!location.description.empty())
+        {
+            writer.Key("description");
+            writer.Value(StyledJsonWriter::FormatString(location.description));
+        }
+        writer.Key("index");
+        writer.Value(StyledJsonWriter::FormatInt(kv.first));
+        if (!location.name.empty())
+        {
+            writer.Key("name");
+            writer.Value(StyledJsonWriter::FormatString(location.name));
+        }
+        if (location.unreachable)
+        {
+            writer.Key("unreachable");
+            writer.Value(StyledJsonWriter::FormatBool(true));
+        }
+        writer.EndObject();
+    }
+    if (has_locations)
+        writer.EndArray();
+
+    if (!state->regions.empty())
+    {
+        writer.Key("regions");
+        writer.BeginArray();
+        for (const auto& region : state->regions)
+        {
+            writer.Element();
+            writer.BeginObject();
+            writer.Key("name");
+            writer.Value(StyledJsonWriter::FormatString(region.name));
+            if (!is_default_rules(region.rules))
+            {
+                writer.Key("rules");
+                write_rules(writer, region.rules);
+            }
+
+            // Runs of consecutive sectors, as first, last pairs
+            values.clear();
+            int first = -1, last = -1;
+            for (auto sectori : region.sectors)
+            {
+                if (sectori == last + 1 && first != -1)
+                {
+                    last = sectori;
+                    continue;
+                }
+                if (first != -1)
+                {
+                    values.push_back(StyledJsonWriter::FormatInt(first));
+                    values.push_back(StyledJsonWriter::FormatInt(last));
+                }
+                first = last = sectori;
+            }
+            if (first != -1)
+            {
+                values.push_back(StyledJsonWriter::FormatInt(first));
+                values.push_back(StyledJsonWriter::FormatInt(last));
+            }
+            if (!values.empty())
             {
-                connection.requirements_and.push_back(requirement_json.asInt());
+                writer.Key("sector_ranges");
+                writer.ScalarArray(values);
             }
+
+            writer.Key("tint");
+            writer.ScalarArray({
+                StyledJsonWriter::FormatFloat(region.tint.r),
+                StyledJsonWriter::FormatFloat(region.tint.g),
+                StyledJsonWriter::FormatFloat(region.tint.b),
+                StyledJsonWriter::FormatFloat(region.tint.a)
+            });
+            writer.EndObject();
         }
+        writer.EndArray();
+    }
 
-        rules.connections.push_back(connection);
+    if (!is_default_rules(state->world_rules))
+    {
+        writer.Key("world_rules");
+        write_rules(writer, state->world_rules);
     }
 
-    return rules;
+    writer.EndObject();
 }
 
 
-void save(game_t* game)
+// Streams the same layout Json::StyledWriter produces, members in sorted order.
+// Runs on the save thread, only touching the job.
+static void run_save_job(save_job_t& job)
 {
-    Json::Value _json;
+    std::string filename = "data/" + job.short_name + ".data.json";
+
+    StyledJsonWriter fragment_writer;
+    for (auto& level : job.levels)
+    {
+        if (!level.state)
+            continue;
+        fragment_writer.BeginFragment(2); // Root object, then "maps" array
+        write_level(fragment_writer, *level.state, level.lump_name);
+        level.fragment = std::make_shared<const std::string>(fragment_writer.EndFragment());
+        auto bin_fragment = std::make_shared<std::string>();
+        encode_level_bin(*bin_fragment, *level.state, level.lump_name, level.ep, level.lvl);
+        level.bin_fragment = std::move(bin_fragment);
+        level.state.reset();
+        level.encoded = true;
+    }
+
+    StyledJsonWriter writer;
+    if (!writer.Open(filename))
+    {
+        job.error = "Can't open '" + filename + ".tmp' for writing.";
+        return;
+    }
+
+    writer.BeginObject();
+    writer.Key("_version");
+    writer.Value(StyledJsonWriter::FormatInt(DATA_JSON_VERSION));
+    writer.Key("maps");
+    writer.BeginArray();
+    for (const auto& level : job.levels)
+    {
+        writer.Element();
+        writer.Raw(*level.fragment);
+    }
+    writer.EndArray();
+    writer.EndObject();
+
+    // Output styled, for ease of source control
+    if (!writer.Commit())
+    {
+        job.error = "Failed to write '" + filename + "', the previous file was kept.";
+        return;
+    }
+
+    // Binary copy for faster loading. It's tied to the json just written, so a stale one is simply ignored.
+    std::string bin;
+    job.json_hash = writer.GetHash();
+    job.json_size = writer.GetSize();
+    encode_data_bin_header(bin, job.json_hash, job.json_size, (int)job.levels.size());
+    for (const auto& level : job.levels)
+        bin += *level.bin_fragment;
+    std::string bin_filename = "data/" + job.short_name + ".data.bin";
+    if (!write_file_atomic(bin_filename, bin))
+        job.warning = "WARNING: Failed to write '" + bin_filename + "', next load will use the json.";
+
+    job.message = (job.autosave ? "Autosaved '" : "Saved '") + filename + "'.";
+}
+
+
+static void save_thread_main()
+{
+    std::unique_lock<std::mutex> lock(save_mutex);
+    while (true)
+    {
+        save_cv.wait(lock, [] { return save_thread_quit || !save_queue.empty(); });
+        if (save_queue.empty())
+            return; // Quitting, with everything written
+        save_job_t job = std::move(save_queue.front());
+        save_queue.pop_front();
+
+        lock.unlock();
+        run_save_job(job);
+        lock.lock();
+
+        save_results.push_back(std::move(job));
+    }
+}
+
+
+// Queues the game for writing. Levels that changed since their last save are copied
+// to be encoded on the save thread, the others reuse their cached fragments.
+void save(game_t* game, bool autosave = false)
+{
+    if (game->data_unreadable)
+    {
+        if (!autosave)
+            OnScreenMessages::AddError("Not saving '" + game->full_name + "', its .data.json couldn't be loaded and would be lost.");
+        return;
+    }
+
+    save_job_t job;
+    job.short_name = game->short_name;
+    job.autosave = autosave;
 
-    Json::Value eps_json(Json::arrayValue);
-    int i = 0;
     int ep = 0;
     for (const auto& episode : game->episodes)
     {
         int lvl = 0;
         for (const auto& meta : episode)
         {
-            Json::Value _map_json;
-            Json::Value bbs_json(Json::arrayValue);
-            auto state = &meta.state;
-            for (const auto& bb : state->bbs)
+            save_level_job_t level;
+            level.ep = ep;
+            level.lvl = lvl;
+            level.lump_name = meta.lump_name;
+            if (meta.save_fragment_version != meta.save_version)
             {
-                Json::Value bb_json(Json::arrayValue);
-                bb_json.append(bb.x1);
-                bb_json.append(bb.y1);
-                bb_json.append(bb.x2);
-                bb_json.append(bb.y2);
-                bb_json.append(bb.region);
-                bbs_json.append(bb_json);
+                level.version = meta.save_version;
+                level.state = std::make_unique<map_state_t>(meta.state);
             }
-            _map_json["bbs"] = bbs_json;
-
-            Json::Value regions_json(Json::arrayValue);
-            for (const auto& region : state->regions)
+            else
             {
-                Json::Value region_json;
-                region_json["name"] = region.name;
-                region_json["tint"] = onut::serializeFloat4(&region.tint.r);
+                level.fragment = meta.save_fragment;
+                level.bin_fragment = meta.save_bin_fragment;
+            }
+            job.levels.push_back(std::move(level));
+            ++lvl;
+        }
+        ++ep;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(save_mutex);
+        if (!save_thread.joinable())
+            save_thread = std::thread(save_thread_main);
 
-                Json::Value sectors_json(Json::arrayValue);
-                for (auto sectori : region.sectors)
-                    sectors_json.append(sectori);
-                region_json["sectors"] = sectors_json;
+        // A newer copy of the same game replaces one still waiting
+        auto it = std::find_if(save_queue.begin(), save_queue.end(), [&job](const save_job_t& queued) { return queued.short_name == job.short_name; });
+        if (it != save_queue.end())
+            *it = std::move(job);
+        else
+        {
+            saves_in_flight[job.short_name]++;
+            save_queue.push_back(std::move(job));
+        }
+    }
+    save_cv.notify_one();
+}
 
-                region_json["rules"] = serialize_rules(region.rules);
 
-                regions_json.append(region_json);
+// Picks up finished saves, called every frame
+void poll_saves()
+{
+    std::vector<save_job_t> results;
+    {
+        std::lock_guard<std::mutex> lock(save_mutex);
+        if (save_results.empty())
+            return;
+        results.swap(save_results);
+    }
+
+    for (auto& job : results)
+    {
+        saves_in_flight[job.short_name]--;
+        auto it = games.find(job.short_name);
+        if (it != games.end())
+        {
+            auto game = &it->second;
+            for (auto& level : job.levels)
+            {
+                // Nothing reached the disk if it failed, the levels stay unsaved so autosave tries again
+                if (!job.error.empty())
+                    break;
+                if (!level.encoded || level.ep >= (int)game->episodes.size() || level.lvl >= (int)game->episodes[level.ep].size())
+                    continue;
+                auto& meta = game->episodes[level.ep][level.lvl];
+                if (level.version < meta.save_fragment_version)
+                    continue; // Already have a newer one
+                meta.save_fragment = std::move(level.fragment);
+                meta.save_bin_fragment = std::move(level.bin_fragment);
+                meta.save_fragment_version = level.version;
+                meta.saved_record = meta.save_bin_fragment;
+                meta.saved_hash = hash_level_bin(*meta.saved_record);
+            }
+
+            // The journal now only needs what changed while this was saving
+            if (job.error.empty())
+            {
+                game->data_hash = job.json_hash;
+                game->data_size = job.json_size;
+                if (game->journal)
+                    fclose(game->journal);
+                game->journal = create_journal("data/" + game->short_name + ".journal", game->data_hash, game->data_size);
+                for (int ep = 0; ep < (int)game->episodes.size(); ++ep)
+                    for (int lvl = 0; lvl < (int)game->episodes[ep].size(); ++lvl)
+                        if (game->episodes[ep][lvl].save_fragment_version != game->episodes[ep][lvl].save_version)
+                            journal_level(game, ep, lvl);
             }
-            _map_json["regions"] = regions_json;
+        }
+
+        if (!job.error.empty())
+            OnScreenMessages::AddError(job.error);
+        if (!job.warning.empty())
+            OnScreenMessages::AddWarning(job.warning);
+        if (!job.message.empty())
+            OnScreenMessages::AddNotice(job.message);
+    }
+}
+
+
+// Lets queued saves finish, for quitting
+void finish_saves()
+{
+    {
+        std::lock_guard<std::mutex> lock(save_mutex);
+        save_thread_quit = true;
+    }
+    save_cv.notify_one();
+    if (save_thread.joinable())
+        save_thread.join();
+}
+
+
+void update_autosave()
+{
+    if (autosave_minutes <= 0)
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_autosave < std::chrono::minutes(autosave_minutes))
+        return;
+    last_autosave = now;
+
+    for (auto& kv : games)
+    {
+        auto game = &kv.second;
+        if (!game->loaded)
+            continue;
+        bool changed = false;
+        for (const auto& episode : game->episodes)
+            for (const auto& meta : episode)
+                changed = changed || meta.save_fragment_version != meta.save_version;
+        if (changed)
+            save(game, true);
+    }
+}
+
+
+static void start_game_load(std::unique_ptr<game_load_job_t> job)
+{
+    auto short_name = job->short_name;
+    job->start_time = get_runtime_us();
+    load_threads[short_name] = std::thread([job = std::move(job)]() mutable
+    {
+        job->succeeded = init_game(job->path, job->game, job->errors, job->reload ? &job->previous_hashes : nullptr);
+        std::lock_guard<std::mutex> lock(load_mutex);
+        load_results.push_back(std::move(job));
+    });
+}
+
+
+void request_game_load(const std::string& short_name, bool generate_when_loaded)
+{
+    auto it = game_catalog.find(short_name);
+    if (it == game_catalog.end())
+        return;
+    auto& entry = it->second;
+    entry.generate_when_loaded = entry.generate_when_loaded || generate_when_loaded;
+    if (entry.state == catalog_state_t::loading || entry.state == catalog_state_t::loaded)
+        return;
+    if (!entry.missing_wad.empty())
+    {
+        OnScreenMessages::AddError("Can't load '" + entry.path + "': '" + entry.missing_wad + "' is missing.");
+        entry.state = catalog_state_t::failed;
+        return;
+    }
+
+    entry.state = catalog_state_t::loading;
+    update_window_title("Loading " + entry.full_name + "...");
+    auto job = std::make_unique<game_load_job_t>();
+    job->short_name = short_name;
+    job->path = entry.path;
+    start_game_load(std::move(job));
+}
+
+
+// After its .game.json or wads changed. Levels with the same lumps keep their geometry.
+void request_game_reload(game_t* game)
+{
+    if (load_threads.count(game->short_name))
+        return;
+
+    auto job = std::make_unique<game_load_job_t>();
+    job->short_name = game->short_name;
+    job->path = game->path;
+    job->reload = true;
+    for (const auto& episode : game->episodes)
+        for (const auto& meta : episode)
+            job->previous_hashes[meta.lump_name] = meta.map.hash;
+    start_game_load(std::move(job));
+}
+
+
+static bool has_unsaved_edits(const game_t* game)
+{
+    for (const auto& episode : game->episodes)
+        for (const auto& meta : episode)
+            if (meta.save_version != 0 && meta.save_fragment_version != meta.save_version)
+                return true;
+    return false;
+}
+
+
+// Textures can only be made on the main thread, from the pixels decoded while loading
+static void create_item_icons(game_t& game)
+{
+    auto& icons = item_icons[game.short_name];
+    icons.assign(game.item_requirements.size(), nullptr);
+    for (int i = 0; i < (int)game.item_requirements.size(); ++i)
+    {
+        auto& item_requirement = game.item_requirements[i];
+        if (item_requirement.icon_pixels.empty())
+            continue;
+        icons[i] = OTexture::createFromData(item_requirement.icon_pixels.data(), {item_requirement.icon_width, item_requirement.icon_height}, false);
+        std::vector<uint8_t>().swap(item_requirement.icon_pixels);
+    }
+}
+
+
+// Puts the reloaded game in place of the old one. Editor state, undo included, carries over
+// for levels that didn't change. Changed levels get their edits applied on the new geometry.
+static void apply_game_reload(game_t* game, game_t& reloaded, long start_time)
+{
+    void clear_map();
+    void select_map(game_t*, int, int);
+
+    std::string active_lump;
+    if (active_level.game_name == game->short_name)
+    {
+        active_lump = get_meta(active_level)->lump_name;
+        clear_map();
+    }
+
+    std::map<std::string, meta_t*> previous; // By lump name
+    for (auto& episode : game->episodes)
+        for (auto& meta : episode)
+            previous[meta.lump_name] = &meta;
 
-            Json::Value accesses_json(Json::arrayValue);
-            for (auto access : state->accesses)
+    std::vector<level_index_t> rebuilt, added;
+    for (int ep = 0; ep < (int)reloaded.episodes.size(); ++ep)
+    {
+        for (int lvl = 0; lvl < (int)reloaded.episodes[ep].size(); ++lvl)
+        {
+            auto& meta = reloaded.episodes[ep][lvl];
+            auto it = previous.find(meta.lump_name);
+            if (it == previous.end())
             {
-                accesses_json.append(access);
+                added.push_back({game->short_name, ep, lvl});
+                continue;
             }
-            _map_json["accesses"] = accesses_json;
+            auto old_meta = it->second;
+            previous.erase(it);
 
-            Json::Value locations_json(Json::arrayValue);
-            for (const auto& kv : state->locations)
+            if (meta.map.unchanged)
             {
-                Json::Value location_json;
-                location_json["index"] = kv.first;
-                location_json["death_logic"] = kv.second.death_logic;
-                location_json["unreachable"] = kv.second.unreachable;
-                location_json["check_sanity"] = kv.second.check_sanity;
-                location_json["name"] = kv.second.name;
-                location_json["description"] = kv.second.description;
-                locations_json.append(location_json);
+                meta.map = std::move(old_meta->map);
+                meta.state = std::move(old_meta->state);
+                meta.state_new = std::move(old_meta->state_new);
+                meta.view = old_meta->view;
+                meta.history = std::move(old_meta->history);
+                meta.save_version = old_meta->save_version;
+                meta.save_fragment_version = old_meta->save_fragment_version;
+                meta.save_fragment = std::move(old_meta->save_fragment);
+                meta.save_bin_fragment = std::move(old_meta->save_bin_fragment);
+                meta.state_hash = old_meta->state_hash;
+                meta.saved_hash = old_meta->saved_hash;
+                meta.state_new_hash = old_meta->state_new_hash;
+                meta.saved_record = std::move(old_meta->saved_record);
+                continue;
             }
-            _map_json["locations"] = locations_json;
 
-            _map_json["world_rules"] = serialize_rules(state->world_rules);
-            _map_json["exit_rules"] = serialize_rules(state->exit_rules);
+            // Goes through the same format as the journal, which maps things and sectors by index
+            std::string record;
+            encode_level_bin(record, old_meta->state, old_meta->lump_name, ep, lvl);
+            saved_level_t level;
+            if (decode_level_bin((const uint8_t*)record.data(), record.size(), level))
+                apply_saved_level(&reloaded, &meta, level);
+            meta.save_version = old_meta->save_version + 1;
+            meta.saved_hash = old_meta->saved_hash;
+            meta.saved_record = std::move(old_meta->saved_record);
+            rebuilt.push_back({game->short_name, ep, lvl});
+        }
+    }
 
-            _map_json["_lump"] = meta.lump_name;
-            // Kept for backwards compatibility
-            _map_json["ep"] = ep;
-            _map_json["map"] = lvl;
+    reloaded.loaded = true;
+    reloaded.journal = game->journal;
+    reloaded.data_hash = game->data_hash;
+    reloaded.data_size = game->data_size;
+    reloaded.data_unreadable = game->data_unreadable;
+    *game = std::move(reloaded);
+    create_item_icons(*game);
+    invalidate_rules_cache();
 
-            eps_json.append(_map_json);
+    for (const auto& idx : added)
+    {
+        first_init_level(game, idx.ep, idx.map);
+        rehash_level(game, idx.ep, idx.map);
+    }
+    for (const auto& idx : rebuilt)
+    {
+        auto record = rehash_level(game, idx.ep, idx.map);
+        journal_level(game, idx.ep, idx.map, &record);
+    }
 
-            ++i;
-            ++lvl;
+    for (int ep = 0; ep < (int)game->episodes.size() && !active_lump.empty(); ++ep)
+    {
+        for (int lvl = 0; lvl < (int)game->episodes[ep].size(); ++lvl)
+        {
+            if (game->episodes[ep][lvl].lump_name == active_lump)
+            {
+                select_map(game, ep, lvl);
+                active_lump.clear();
+                break;
+            }
         }
-        ++ep;
     }
 
-    _json["maps"] = eps_json;
+    if (!previous.empty())
+        OnScreenMessages::AddWarning(std::to_string(previous.size()) + " level(s) were removed from '" + game->full_name + "', their edits will be dropped on the next save.");
+    OnScreenMessages::AddNotice("Reloaded game '" + game->full_name + "', " + std::to_string(rebuilt.size() + added.size()) + " level(s) rebuilt (" + compare_runtime(start_time) + " sec)");
+}
+
+
+// The .data.json was changed by something else than us, e.g. checking out another version
+static void reload_game_data(game_t* game)
+{
+    void clear_map();
+    void select_map(game_t*, int, int);
 
     std::string filename = "data/" + game->short_name + ".data.json";
-    // Output styled, for ease of source control
-    onut::saveJson(_json, filename, true);
+    auto json_data = read_file_data(filename);
+    if (hash_bytes(json_data.data(), json_data.size()) == game->data_hash && json_data.size() == game->data_size)
+        return; // What we last saved or loaded
+    if (has_unsaved_edits(game))
+    {
+        OnScreenMessages::AddWarning("'" + filename + "' changed on disk, but '" + game->full_name + "' has unsaved changes. Not reloading it.");
+        return;
+    }
 
-    OnScreenMessages::Add("Saved '" + filename + "'.", ImColor(0.0f, 0.3f, 0.0f));
+    bool was_active = active_level.game_name == game->short_name;
+    auto active = active_level;
+    clear_map();
+    for (auto& episode : game->episodes)
+    {
+        for (auto& meta : episode)
+        {
+            meta.state = map_state_t();
+            meta.history = map_history_t();
+            meta.save_version = 0;
+        }
+    }
+
+    // The journal was of edits on top of the old file
+    if (game->journal)
+        fclose(game->journal);
+    game->journal = nullptr;
+    load(game);
+    invalidate_rules_cache();
+    if (was_active)
+        select_map(game, active.ep, active.map);
+    OnScreenMessages::AddNotice("Reloaded '" + filename + "'");
 }
 
 
-void load(game_t* game)
+void watch_game(const game_t* game)
 {
-    game->loaded = true;
+    for (auto it = watched_files.begin(); it != watched_files.end();)
+    {
+        if (it->second.short_name == game->short_name)
+            it = watched_files.erase(it);
+        else
+            ++it;
+    }
 
-    Json::Value json;
-    std::string filename = "data/" + game->short_name + ".data.json";
-    if (!onut::loadJson(json, filename))
+    auto paths = get_game_files(game);
+
+    for (int i = 0; i < (int)paths.size(); ++i)
     {
-        OnScreenMessages::AddWarning("WARNING: " + filename + " not found.\n(If you just created this game, then it's fine. Otherwise, scream.)");
+        auto& file = watched_files[paths[i]];
+        file.short_name = game->short_name;
+        file.is_data = (i == (int)paths.size() - 1);
+        std::error_code ec;
+        file.time = std::filesystem::last_write_time(paths[i], ec);
+        file.size = ec ? 0 : std::filesystem::file_size(paths[i], ec);
+    }
+}
 
-        // Initialize level's Hub and Exit "regions" to reasonable places
-        void first_init_level(game_t*, int, int);
-        for (int ep = 0; ep < game->episodes.size(); ++ep)
-            for (int lvl = 0; lvl < game->episodes[ep].size(); ++lvl)
-                first_init_level(game, ep, lvl);
 
+// Stat'ing a handful of files once a second is cheap enough, and works the same everywhere
+void poll_watched_files()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_watch_poll < std::chrono::seconds(1))
         return;
+    last_watch_poll = now;
+
+    std::set<std::string> changed_games, changed_data;
+    for (auto& kv : watched_files)
+    {
+        auto& file = kv.second;
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time(kv.first, ec);
+        auto size = ec ? 0 : std::filesystem::file_size(kv.first, ec);
+        if (time == file.time && size == file.size)
+            continue;
+
+        // Left as changed until it can be looked at
+        if (file.is_data ? saves_in_flight[file.short_name] > 0 : load_threads.count(file.short_name) > 0)
+            continue;
+        file.time = time;
+        file.size = size;
+        (file.is_data ? changed_data : changed_games).insert(file.short_name);
     }
 
-    // Lump name: <game, ep, map>
-    // We prefer using lump name to canonically refer to a saved map's data,
-    // because otherwise moving maps around between episodes gets messy.
-    std::map<std::string, level_index_t> lumpname_to_index;
-    for (int ep = 0; ep < game->episodes.size(); ++ep)
-        for (int lvl = 0; lvl < game->episodes[ep].size(); ++lvl)
-            lumpname_to_index.emplace(game->episodes[ep][lvl].lump_name, level_index_t{game->short_name, ep, lvl});
+    for (const auto& short_name : changed_games)
+    {
+        auto it = games.find(short_name);
+        if (it != games.end())
+            request_game_reload(&it->second);
+    }
+    for (const auto& short_name : changed_data)
+    {
+        auto it = games.find(short_name);
+        if (it != games.end() && !changed_games.count(short_name))
+            reload_game_data(&it->second);
+    }
+}
 
-    Json::Value json_maps = json["maps"];
 
-    for (const auto& _map_json : json_maps)
+// Picks up games done loading, called every frame
+void poll_game_loads()
+{
+    std::vector<std::unique_ptr<game_load_job_t>> results;
     {
-        meta_t* meta = nullptr;
+        std::lock_guard<std::mutex> lock(load_mutex);
+        if (load_results.empty())
+            return;
+        results.swap(load_results);
+    }
 
-        std::string lumpname = _map_json.get("_lump", "INVALIDNAME").asString();
-        if (lumpname_to_index.count(lumpname) > 0)
+    for (auto& job : results)
+    {
+        auto thread_it = load_threads.find(job->short_name);
+        if (thread_it != load_threads.end())
         {
-            meta = get_meta(lumpname_to_index[lumpname]);
+            thread_it->second.join();
+            load_threads.erase(thread_it);
         }
-        else // Fallback to using ep/map from before
+
+        auto& entry = game_catalog[job->short_name];
+        for (const auto& error : job->errors)
+            OnScreenMessages::AddError(error);
+
+        if (job->reload)
         {
-            int ep = _map_json["ep"].asInt();
-            int lvl = _map_json["map"].asInt();
-            meta = get_meta({game->short_name, ep, lvl});
-        }
-        if (!meta)
+            auto it = games.find(job->short_name);
+            if (!job->succeeded || it == games.end())
+                OnScreenMessages::AddWarning("Keeping the previously loaded '" + entry.full_name + "'.");
+            else if (job->game.short_name != job->short_name)
+                OnScreenMessages::AddError("'" + job->path + "' changed its short name, reopen it to load it.");
+            else
+            {
+                apply_game_reload(&it->second, job->game, job->start_time);
+                watch_game(&it->second);
+            }
             continue;
+        }
 
-        auto _map_state = &meta->state;
-
-        const auto& bbs_json = _map_json["bbs"];
-        for (const auto& bb_json : bbs_json)
+        if (!job->succeeded)
         {
-            _map_state->bbs.push_back({
-                bb_json[0].asInt(),
-                bb_json[1].asInt(),
-                bb_json[2].asInt(),
-                bb_json[3].asInt(),
-                bb_json.isValidIndex(4) ? bb_json[4].asInt() : -1,
-            });
+            entry.state = catalog_state_t::failed;
+            continue;
         }
 
-        const auto& regions_json = _map_json["regions"];
-        for (const auto& region_json : regions_json)
+        auto game = &games[job->short_name];
+        *game = std::move(job->game);
+        create_item_icons(*game);
+        load(game);
+        invalidate_rules_cache();
+        watch_game(game);
+        entry.state = catalog_state_t::loaded;
+        OnScreenMessages::AddNotice("Loaded game '" + game->full_name + "' (" + compare_runtime(job->start_time) + " sec)");
+
+        if (entry.generate_when_loaded)
         {
-            region_t region;
+            entry.generate_when_loaded = false;
+            save(game);
+            generate(game);
+        }
+    }
+    if (load_threads.empty())
+        update_window_title();
+}
 
-            region.name = region_json.get("name", "BAD_NAME").asString();
-            onut::deserializeFloat4(&region.tint.r, region_json["tint"]);
 
-            const auto& sectors_json = region_json["sectors"];
-            for (const auto& sector_json : sectors_json)
-                region.sectors.insert(sector_json.asInt());
+// Waits on loads still going, for quitting
+void finish_game_loads()
+{
+    for (auto& kv : load_threads)
+        kv.second.join();
+    load_threads.clear();
+    load_results.clear();
+}
 
-            region.rules = deserialize_rules(region_json["rules"]);
 
-            _map_state->regions.push_back(region);
-        }
+static bool generate_all_pending = false; // Once every listed game is done loading
 
-        const auto& accesses_json = _map_json["accesses"];
-        for (const auto& access_json : accesses_json)
-        {
-            _map_state->accesses.insert(access_json.asInt());
-        }
+// Loads every listed game, then generates all of them at once
+void request_generate_all()
+{
+    generate_all_pending = true;
+    for (const auto& kv : game_catalog)
+    {
+        if (kv.second.state == catalog_state_t::listed)
+            request_game_load(kv.first, false);
+    }
+}
 
-        // Default locations from maps
-        auto map = &meta->map;
-        for (int i = 0; i < (int)map->things.size(); ++i)
-        {
-            const auto& thing = map->things[i];
-            if (thing.flags & THING_FLAG_MP_ONLY) continue; // Thing is not in single player
-            if (game->location_doom_types.find(thing.type) != game->location_doom_types.end())
-            {
-                location_t location;
-                _map_state->locations[i] = location;
-            }
-        }
-            
-        const auto& locations_json = _map_json["locations"];
-        for (const auto& location_json : locations_json)
-        {
-            location_t location;
-            int index = location_json["index"].asInt();
-            const auto& thing = map->things[index];
-            if (thing.flags & THING_FLAG_MP_ONLY) continue; // Thing is not in single player
-            if (game->location_doom_types.find(thing.type) != game->location_doom_types.end())
-            {
-                location.death_logic = location_json["death_logic"].asBool();
-                location.unreachable = location_json["unreachable"].asBool();
-                location.check_sanity = location_json["check_sanity"].asBool();
-                if (location.check_sanity) _map_state->check_sanity_count++;
-                location.name = location_json["name"].asString();
-                location.description = location_json["description"].asString();
-                _map_state->locations[index] = location;
-            }
-        }
 
-        _map_state->world_rules = deserialize_rules(_map_json["world_rules"]);
-        _map_state->exit_rules = deserialize_rules(_map_json["exit_rules"]);
+// Called every frame, after poll_game_loads()
+void poll_generate_all()
+{
+    if (!generate_all_pending)
+        return;
+    for (const auto& kv : game_catalog)
+    {
+        if (kv.second.state == catalog_state_t::loading)
+            return;
+    }
+    generate_all_pending = false;
 
-        meta->view.cam_pos = Vector2((float)(map->bb[2] + map->bb[0]) / 2, -(float)(map->bb[3] + map->bb[1]) / 2);
+    std::vector<game_t*> to_generate;
+    for (auto& kv : games)
+    {
+        save(&kv.second);
+        to_generate.push_back(&kv.second);
+    }
+    if (to_generate.empty())
+    {
+        OnScreenMessages::AddError("No games could be loaded to generate.");
+        return;
     }
+    generate_all(to_generate);
 }
 
 
@@ -490,15 +1175,17 @@ void open_single_world_dialog(void)
 
     if (res.empty()) return;
 
-    init_worlds({res}, false);
+    catalog_games({res});
 
-    update_window_title("Loading world data and logic...");
-    for (auto& kv : games)
+    // Opening a single game means wanting to work on it, so load it right away
+    for (const auto& kv : game_catalog)
     {
-        auto game = &kv.second;
-        if (!game->loaded) load(game);
+        if (kv.second.path == res)
+        {
+            request_game_load(kv.first, false);
+            break;
+        }
     }
-    update_window_title();
 }
 
 
@@ -509,34 +1196,72 @@ void open_all_worlds_dialog(void)
 
     if (res.empty()) return;
 
-    constexpr std::string_view extension{".GAME.JSON"};
-    std::vector<std::string> allFiles = onut::findAllFiles(res, "*", false);
-    std::vector<std::string> filteredFiles;
-    for (auto file : allFiles)
-    {
-        if (file.size() > extension.size() &&
-            onut::toUpper(file.substr(file.size() - extension.size())) == extension)
-        {
-            filteredFiles.emplace_back(file);
-        }
-    }
-    init_worlds(filteredFiles);
-
-    update_window_title("Loading world data and logic...");
-    for (auto& kv : games)
-    {
-        auto game = &kv.second;
-        if (!game->loaded) load(game);
-    }
-    update_window_title();
+    // Games only get loaded once picked from the menu
+    catalog_games(find_game_jsons(res));
 }
 
 
 // Undo/Redo shit
+void mark_level_dirty()
+{
+    auto meta = get_meta(active_level);
+    if (!meta) return;
+    meta->save_version++;
+    auto record = rehash_level(get_game(active_level), active_level.ep, active_level.map);
+    journal_level(get_game(active_level), active_level.ep, active_level.map, &record);
+}
+
+
+// Decodes the last saved version of the level into state_new, if it isn't there already
+void refresh_saved_state(const level_index_t& idx, bool force = false)
+{
+    auto game = get_game(idx);
+    auto meta = get_meta(idx);
+    if (!meta || (!force && meta->state_new_hash == meta->saved_hash))
+        return;
+
+    meta->state_new = map_state_t();
+    saved_level_t level;
+    if (meta->saved_record && decode_level_bin((const uint8_t*)meta->saved_record->data(), meta->saved_record->size(), level))
+        apply_saved_state(game, &meta->map, &meta->state_new, level);
+    meta->state_new_hash = meta->saved_hash;
+    invalidate_rules_cache();
+}
+
+
+// The level as it was opened, to undo back to. Opening it isn't an edit, and a level opened
+// while showing the saved version gets it when switching back to the current one.
+static void push_opened_state()
+{
+    if (map_history == nullptr || !map_history->history.empty() || active_source != active_source_t::current)
+        return;
+    map_history->history.push_back(*map_state);
+    map_history->history_point = 0;
+}
+
+
+void show_source(active_source_t source)
+{
+    active_source = source;
+    if (active_source == active_source_t::target)
+        refresh_saved_state(active_level);
+    map_state = get_state(active_level, active_source);
+    push_opened_state();
+}
+
+
 void push_undo()
 {
     if (map_history == nullptr)
         return;
+    if (active_source == active_source_t::target)
+    {
+        // Only there to look at, changes to it don't stick
+        refresh_saved_state(active_level, true);
+        OnScreenMessages::Add("The saved version can't be edited, use Diff > Apply Target to continue from it.");
+        return;
+    }
+    mark_level_dirty();
     if (map_history->history_point < (int)map_history->history.size() - 1)
         map_history->history.erase(map_history->history.begin() + (map_history->history_point + 1), map_history->history.end());
     map_history->history.push_back(*map_state);
@@ -556,6 +1281,7 @@ void clear_map()
     map_state = nullptr;
     map_view = nullptr;
     map_history = nullptr;
+    invalidate_rules_cache();
 }
 
 void select_map(game_t* game, int ep, int map)
@@ -563,24 +1289,27 @@ void select_map(game_t* game, int ep, int map)
     clear_map();
 
     active_level = {game->short_name, ep, map};
+    if (active_source == active_source_t::target)
+        refresh_saved_state(active_level);
     map_state = get_state(active_level, active_source);
     map_view = get_view(active_level);
     map_history = get_history(active_level);
 
     update_window_title();
-    if (map_history->history.empty())
-        push_undo();
+    push_opened_state();
 }
 
 
 void undo()
 {
-    if (map_history == nullptr)
+    if (map_history == nullptr || active_source == active_source_t::target)
         return;
     if (map_history->history_point > 0)
     {
         map_history->history_point--;
         *map_state = map_history->history[map_history->history_point];
+        invalidate_rules_cache();
+        mark_level_dirty();
 
         map_state->check_sanity_count = 0;
         for (const auto& loc : map_state->locations)
@@ -596,12 +1325,14 @@ void undo()
 
 void redo()
 {
-    if (map_history == nullptr)
+    if (map_history == nullptr || active_source == active_source_t::target)
         return;
     if (map_history->history_point < (int)map_history->history.size() - 1)
     {
         map_history->history_point++;
         *map_state = map_history->history[map_history->history_point];
+        invalidate_rules_cache();
+        mark_level_dirty();
     }
     else
         OnScreenMessages::Add("No action to redo");
@@ -641,8 +1372,11 @@ void init()
     ap_player_start_icon = OGetTexture("player_start.png");
     ap_wing_icon = OGetTexture("wings.png");
 
+    core_arguments = OArguments; // The core reads its options from there
     init_data();
 
+    autosave_minutes = std::max(0, atoi(oSettings->getUserSetting("autosave_minutes").c_str()));
+
     // Doom1 only
     //for (int ep = 0; ep < EP_COUNT; ++ep)
     //{
@@ -673,11 +1407,33 @@ void init()
     //select_map(&games.begin()->second, 0, 0);
 
     OnScreenMessages::Add("Welcome to the APDoom Gen Tool - version " APGENTOOL_VERSION);
+
+    // Builds every game in the games folder, then carries on as usual
+    for (const auto& arg : OArguments)
+    {
+        if (arg == "--generate-all")
+        {
+            catalog_games(find_game_jsons((std::filesystem::current_path() / "games").string()));
+            request_generate_all();
+            break;
+        }
+    }
 }
 
 
 void shutdown() // lol
 {
+    finish_game_loads();
+    finish_saves();
+    poll_saves();
+
+    // Left behind on purpose, unsaved changes come back next time
+    for (auto& kv : games)
+    {
+        if (kv.second.journal)
+            fclose(kv.second.journal);
+        kv.second.journal = nullptr;
+    }
 }
 
 
@@ -700,6 +1456,7 @@ void delete_selected()
             if (map_state->selected_bb != -1)
             {
                 map_state->bbs.erase(map_state->bbs.begin() + map_state->selected_bb);
+                map_state->bb_index.invalidate();
                 map_state->selected_bb = -1;
                 push_undo();
             }
@@ -711,6 +1468,7 @@ void delete_selected()
                 if (rules)
                 {
                     rules->connections.erase(rules->connections.begin() + set_rule_connection);
+                    invalidate_rules_cache();
                     set_rule_rule = -3;
                     set_rule_connection = -1;
                     push_undo();
@@ -723,35 +1481,14 @@ void delete_selected()
 }
 
 
-void first_init_level(game_t* game, int ep, int lvl)
-{
-    auto state = get_state({game->short_name, ep, lvl});
-    auto map = get_map({game->short_name, ep, lvl});
-
-    state->bbs.clear();
-    state->selected_bb = -1;
-    state->selected_region = -1;
-    state->selected_location = -1;
-    state->accesses.clear();
-    state->regions.clear();
-
-    Point rules_pos = {
-        (int)map->bb[0] - RULES_W * 2,
-        (int)map->bb[1] + ((int)map->bb[3] - (int)map->bb[1]) / 2
-    };
-    state->exit_rules.x = rules_pos.x;
-    state->exit_rules.y = rules_pos.y + RULES_H;
-    state->world_rules.x = rules_pos.x;
-    state->world_rules.y = rules_pos.y - RULES_H;
-}
-
-
 void reset_level()
 {
     auto state = get_state(active_level);
     auto map = get_map(active_level);
+    invalidate_rules_cache();
 
     state->bbs.clear();
+    state->bb_index.invalidate();
     state->selected_bb = -1;
     state->selected_region = -1;
     state->selected_location = -1;
@@ -763,6 +1500,7 @@ void reset_level()
     state->regions.push_back(main_region);
     for (int i = 0, len = (int)map->sectors.size(); i < len; ++i)
         state->regions[0].sectors.insert(i);
+    state->rebuild_sector_regions((int)map->sectors.size());
 
     Point rules_pos = {
         (int)map->bb[0] - RULES_W * 2,
@@ -790,14 +1528,9 @@ void reset_level()
         {
             continue; // Thing is not in single player
         }
-        for (const auto& key_item : game->keys)
-        {
-            if (thing.type == key_item.item.doom_type)
-            {
-                keycards[key_item.key] = true;
-                break;
-            }
-        }
+        int key_slot = game->doom_types[thing.type].key_slot;
+        if (key_slot != -1)
+            keycards[key_slot] = true;
     }
 
     for (int i = 0; i < 3; ++i)
@@ -853,16 +1586,8 @@ void update_shortcuts()
     if (!ctrl && !shift && !alt && OInputJustPressed(OKeyDelete)) delete_selected();
     if (ctrl && !shift && !alt && OInputJustPressed(OKeyS)) save(get_game(active_level));
     if (ctrl && !shift && !alt && OInputJustPressed(OKeyR)) reset_level();
-    if (!ctrl && !shift && !alt && OInputJustPressed(OKeyF1))
-    {
-        active_source = active_source_t::current;
-        map_state = get_state(active_level, active_source);
-    }
-    if (!ctrl && !shift && !alt && OInputJustPressed(OKeyF2))
-    {
-        active_source = active_source_t::target;
-        map_state = get_state(active_level, active_source);
-    }
+    if (!ctrl && !shift && !alt && OInputJustPressed(OKeyF1)) show_source(active_source_t::current);
+    if (!ctrl && !shift && !alt && OInputJustPressed(OKeyF2)) show_source(active_source_t::target);
 }
 
 
@@ -905,7 +1630,14 @@ int get_bb_at(const Vector2& pos, float zoom, int &edge)
         if (test_bb(map_state->bbs[map_state->selected_bb], pos, zoom, edge))
             return map_state->selected_bb;
     }
-    for (int i = 0; i < (int)map_state->bbs.size(); ++i)
+
+    // Only boxes within grabbing distance of an edge can pass test_bb
+    static std::vector<int> candidates;
+    int margin = (int)std::ceil(8.0f / zoom) + 1;
+    int x = (int)std::floor(pos.x);
+    int y = (int)std::floor(-pos.y);
+    map_state->bb_index.query(map_state->bbs, x - margin, y - margin, x + margin, y + margin, candidates);
+    for (int i : candidates)
     {
         if (test_bb(map_state->bbs[i], pos, zoom, edge))
             return i;
@@ -917,60 +1649,29 @@ int get_bb_at(const Vector2& pos, float zoom, int &edge)
 int get_loc_at(const Vector2& pos)
 {
     auto map = get_map(active_level);
-    auto game = get_game(active_level);
 
-    int index = 0;
-    for (const auto& thing : map->things)
+    // Only things within picking distance of the cursor can be under it.
+    // The grid is in map space, where Y is flipped.
+    static std::vector<int> candidates;
+    int x = (int)std::floor(pos.x);
+    int y = (int)std::floor(-pos.y);
+    query_grid(map->location_grid, x - 33, y - 33, x + 33, y + 33, candidates);
+
+    // Candidates are sorted, so the first hit is the same one a full scan would find
+    for (int index : candidates)
     {
-        if (thing.flags & THING_FLAG_MP_ONLY)
-        {
-            ++index;
-            continue; // Thing is not in single player
-        }
-        if (game->location_doom_types.find(thing.type) != game->location_doom_types.end())
+        const auto& thing = map->things[index];
+        Rect rect((float)thing.x - 32.0f, (float)-thing.y - 32.0f, 64.0f, 64.0f);
+        if (rect.Contains(pos))
         {
-            Rect rect((float)thing.x - 32.0f, (float)-thing.y - 32.0f, 64.0f, 64.0f);
-            if (rect.Contains(pos))
-            {
-                return index;
-            }
+            return index;
         }
-        ++index;
     }
 
     return -1;
 }
 
 
-// -1 = world, -2 = exit, -3 = not found
-int get_rule_at(const Vector2& pos)
-{
-    if (pos.x >= (float)map_state->world_rules.x - RULES_W * 0.5f &&
-        pos.x <= (float)map_state->world_rules.x + RULES_W * 0.5f &&
-        pos.y <= -(float)map_state->world_rules.y + RULES_H * 0.5f &&
-        pos.y >= -(float)map_state->world_rules.y - RULES_H * 0.5f)
-        return -1;
-
-    if (pos.x >= (float)map_state->exit_rules.x - RULES_W * 0.5f &&
-        pos.x <= (float)map_state->exit_rules.x + RULES_W * 0.5f &&
-        pos.y <= -(float)map_state->exit_rules.y + RULES_H * 0.5f &&
-        pos.y >= -(float)map_state->exit_rules.y - RULES_H * 0.5f)
-        return -2;
-
-    for (int i = (int)map_state->regions.size() - 1; i >= 0; --i)
-    {
-        const auto& region = map_state->regions[i];
-        if (pos.x >= (float)region.rules.x - RULES_W * 0.5f &&
-            pos.x <= (float)region.rules.x + RULES_W * 0.5f &&
-            pos.y <= -(float)region.rules.y + RULES_H * 0.5f &&
-            pos.y >= -(float)region.rules.y - RULES_H * 0.5f)
-            return i;
-    }
-
-    return -3;
-}
-
-
 Vector2 get_rect_edge_pos(Vector2 from, Vector2 to, float side_offset, bool invert_offset)
 {
     const auto RECT_HW = RULES_W * 0.5f + 32.0f;
@@ -1028,71 +1729,144 @@ Vector2 get_rect_edge_pos(Vector2 from, Vector2 to, float side_offset, bool inve
 }
 
 
-double dist_to_line(const Vector2& p1, const Vector2& p2, const Vector2& point)
+// Squared distance from a point to the segment p1-p2
+float dist_to_segment_sq(const Vector2& p1, const Vector2& p2, const Vector2& point)
 {
-#define square(x) ((x)*(x))
-    const double dist_line = sqrt(square(p2.x - p1.x) + square(p2.y - p1.y));
-    const double dist_p1 = sqrt(square(point.x - p1.x) + square(point.y - p1.y));
-    const double dist_p2 = sqrt(square(point.x - p2.x) + square(point.y - p2.y));
+    Vector2 d = p2 - p1;
+    float len_sq = d.Dot(d);
+    float t = len_sq > 0.0f ? std::clamp((point - p1).Dot(d) / len_sq, 0.0f, 1.0f) : 0.0f;
+    Vector2 closest = p1 + d * t - point;
+    return closest.Dot(closest);
+}
+
 
-    if ((square(dist_line) + square(dist_p1) - square(dist_p2)) / (2 * dist_line * dist_p1) < 0)
-        return dist_p1; // Past the line on point 1's side
-    if ((square(dist_line) + square(dist_p2) - square(dist_p1)) / (2 * dist_line * dist_p2) < 0)
-        return dist_p2; // Past the line on point 2's side
+// Rules are cached in slots: world, then each region, then exit. Same order connections are hit tested in.
+int get_rule_slot(int rule)
+{
+    if (rule == -1) return 0;
+    if (rule == -2) return (int)map_state->regions.size() + 1;
+    return rule + 1;
+}
 
-    const Vector2 adj_p1 = {p1.x - point.x, p1.y - point.y};
-    const Vector2 adj_p2 = {p2.x - point.x, p2.y - point.y};
-    return abs((adj_p1.x * adj_p2.y) - (adj_p2.x * adj_p1.y)) / dist_line;
+int get_slot_rule(int slot)
+{
+    if (slot == 0) return -1;
+    if (slot == (int)map_state->regions.size() + 1) return -2;
+    return slot - 1;
 }
 
 
-// -1 = not found
-int get_connection_at(const Vector2& pos, const rule_region_t& rules)
+const rules_cache_t& get_rules_cache()
 {
-    Vector2 center((float)rules.x, -(float)rules.y);
+    auto& cache = rules_cache;
+    if (cache.state == map_state && cache.region_count == (int)map_state->regions.size())
+        return cache;
 
-    int i = 0;
-    for (const auto& connection : rules.connections)
+    cache.state = map_state;
+    cache.region_count = (int)map_state->regions.size();
+    cache.centers.clear();
+    cache.segments.clear();
+    cache.segment_offsets.clear();
+
+    int slot_count = cache.region_count + 2;
+    for (int slot = 0; slot < slot_count; ++slot)
     {
-        auto other_rules = get_rules(connection.target_region);
-        if (!other_rules) continue;
+        const auto& rules = *get_rules(get_slot_rule(slot));
+        cache.centers.push_back(Vector2((float)rules.x, -(float)rules.y));
+    }
 
-        Vector2 other_center((float)other_rules->x, -(float)other_rules->y);
-        Vector2 from = get_rect_edge_pos(center, other_center, RULE_CONNECTION_OFFSET, false);
-        Vector2 to = get_rect_edge_pos(other_center, center, RULE_CONNECTION_OFFSET, true);
-        double d = dist_to_line(from, to, {pos.x, pos.y});
-        if (d <= 24.0f / map_view->cam_zoom) return i;
-        i++;
+    std::vector<map_grid_entry_t> grid_entries;
+    int x1 = INT_MAX, y1 = INT_MAX, x2 = INT_MIN, y2 = INT_MIN;
+    for (int slot = 0; slot < slot_count; ++slot)
+    {
+        const auto& rules = *get_rules(get_slot_rule(slot));
+        const auto& center = cache.centers[slot];
+        cache.segment_offsets.push_back((int)cache.segments.size());
+        for (int c = 0; c < (int)rules.connections.size(); ++c)
+        {
+            const auto& other_center = cache.centers[get_rule_slot(rules.connections[c].target_region)];
+
+            rule_segment_t segment;
+            segment.connection = c;
+            segment.from = get_rect_edge_pos(center, other_center, RULE_CONNECTION_OFFSET, false);
+            segment.to = get_rect_edge_pos(other_center, center, RULE_CONNECTION_OFFSET, true);
+            segment.dir = segment.to - segment.from;
+            segment.dir.Normalize();
+            segment.right = Vector2(-segment.dir.y, segment.dir.x);
+
+            map_grid_entry_t entry = {
+                (int)cache.segments.size(),
+                (int)std::floor(std::min(segment.from.x, segment.to.x)),
+                (int)std::floor(std::min(segment.from.y, segment.to.y)),
+                (int)std::ceil(std::max(segment.from.x, segment.to.x)),
+                (int)std::ceil(std::max(segment.from.y, segment.to.y))
+            };
+            x1 = std::min(x1, entry.x1); y1 = std::min(y1, entry.y1);
+            x2 = std::max(x2, entry.x2); y2 = std::max(y2, entry.y2);
+            grid_entries.push_back(entry);
+            cache.segments.push_back(segment);
+        }
     }
-    return -1;
+    cache.segment_offsets.push_back((int)cache.segments.size());
+
+    cache.grid = map_grid_t();
+    cache.grid.cell_size = RULES_W;
+    if (!grid_entries.empty())
+        build_grid(cache.grid, x1, y1, x2, y2, grid_entries);
+
+    return cache;
 }
 
-void get_connection_at(const Vector2& pos, int& rule, int& connection)
+
+// -1 = world, -2 = exit, -3 = not found
+int get_rule_at(const Vector2& pos)
 {
-    connection = get_connection_at(pos, map_state->world_rules);
-    if (connection != -1)
+    const auto& cache = get_rules_cache();
+
+    auto test_rule = [&pos, &cache](int slot)
     {
-        rule = -1;
-        return;
+        const auto& center = cache.centers[slot];
+        return pos.x >= center.x - RULES_W * 0.5f &&
+               pos.x <= center.x + RULES_W * 0.5f &&
+               pos.y <= center.y + RULES_H * 0.5f &&
+               pos.y >= center.y - RULES_H * 0.5f;
+    };
+
+    if (test_rule(0)) return -1;
+    if (test_rule(cache.region_count + 1)) return -2;
+    for (int i = cache.region_count - 1; i >= 0; --i)
+    {
+        if (test_rule(i + 1)) return i;
     }
 
-    for (int i = 0; i < (int)map_state->regions.size(); ++i)
+    return -3;
+}
+
+
+void get_connection_at(const Vector2& pos, int& rule, int& connection)
+{
+    const auto& cache = get_rules_cache();
+
+    float tolerance = 24.0f / map_view->cam_zoom;
+    int margin = (int)std::ceil(tolerance) + 1;
+    int x = (int)std::floor(pos.x);
+    int y = (int)std::floor(pos.y);
+    static std::vector<int> candidates;
+    query_grid(cache.grid, x - margin, y - margin, x + margin, y + margin, candidates);
+
+    // Candidates are in slot order, so the first hit matches the world, regions, exit priority
+    for (int s : candidates)
     {
-        connection = get_connection_at(pos, map_state->regions[i].rules);
-        if (connection != -1)
+        const auto& segment = cache.segments[s];
+        if (dist_to_segment_sq(segment.from, segment.to, pos) <= tolerance * tolerance)
         {
-            rule = i;
+            int slot = (int)(std::upper_bound(cache.segment_offsets.begin(), cache.segment_offsets.end(), s) - cache.segment_offsets.begin()) - 1;
+            rule = get_slot_rule(slot);
+            connection = segment.connection;
             return;
         }
     }
 
-    connection = get_connection_at(pos, map_state->exit_rules);
-    if (connection != -1)
-    {
-        rule = -2;
-        return;
-    }
-
     rule = -3;
     connection = -1;
 }
@@ -1139,6 +1913,12 @@ void update_gen()
 
 void update()
 {
+    poll_game_loads();
+    poll_generate_all();
+    poll_saves();
+    poll_watched_files();
+    update_autosave();
+
     if (map_view == nullptr)
     {
         if (!ImGui::GetIO().WantCaptureKeyboard)
@@ -1149,7 +1929,7 @@ void update()
     }
 
     // Update mouse pos in world
-    auto cam_matrix = Matrix::Create2DTranslationZoom(OScreenf, map_view->cam_pos, map_view->cam_zoom);
+    auto cam_matrix = Matrix::Create2DTranslationZoom(OScreenf, to_vector2(map_view->cam_pos), map_view->cam_zoom);
     auto inv_cam_matrix = cam_matrix.Invert();
     mouse_pos = Vector2::Transform(OGetMousePos(), inv_cam_matrix);
 
@@ -1243,13 +2023,23 @@ void update()
                         push_undo();
                     }
                     
-                    if (OInputPressed(OMouse1))
+                    if (OInputJustPressed(OMouse1) && (OInputPressed(OKeyLeftShift) || OInputPressed(OKeyRightShift)))
+                    {
+                        // Flood fill selected region, as a single undo step
+                        if (mouse_hover_sector != -1 && map_state->selected_region != -1)
+                        {
+                            auto sectors = flood_fill_sectors(get_map(active_level), mouse_hover_sector, flood_fill_stop);
+                            for (auto sectori : sectors)
+                                map_state->set_sector_region(sectori, map_state->selected_region);
+                            push_undo();
+                        }
+                    }
+                    else if (OInputPressed(OMouse1))
                     {
                         // "paint" selected region
                         if (mouse_hover_sector != -1 && map_state->selected_region != -1)
                         {
-                            for (auto& region : map_state->regions) region.sectors.erase(mouse_hover_sector);
-                            map_state->regions[map_state->selected_region].sectors.insert(mouse_hover_sector);
+                            map_state->set_sector_region(mouse_hover_sector, map_state->selected_region);
                             painted = true;
                         }
                     }
@@ -1258,7 +2048,7 @@ void update()
                         // "erase" selected region
                         if (mouse_hover_sector != -1)
                         {
-                            for (auto& region : map_state->regions) region.sectors.erase(mouse_hover_sector);
+                            map_state->set_sector_region(mouse_hover_sector, -1);
                             painted = true;
                         }
                     }
@@ -1268,6 +2058,7 @@ void update()
                         for (auto& region : map_state->regions) region.sectors.clear();
                         for (int i = 0, len = (int)get_map(active_level)->sectors.size(); i < len; ++i)
                             map_state->regions[map_state->selected_region].sectors.insert(i);
+                        map_state->rebuild_sector_regions((int)get_map(active_level)->sectors.size());
                         painted = true;
                     }
                 }
@@ -1352,7 +2143,7 @@ void update()
             ImGui::GetIO().WantCaptureMouse = false;
             ImGui::GetIO().WantCaptureKeyboard = false;
             auto diff = OGetMousePos() - mouse_pos_on_down;
-            map_view->cam_pos = cam_pos_on_down - diff / map_view->cam_zoom;
+            map_view->cam_pos = cam_pos_on_down - to_vec2(diff / map_view->cam_zoom);
             if (OInputJustReleased(OMouse3) || OInputJustReleased(OKeySpaceBar))
                 state = state_t::idle;
             break;
@@ -1372,6 +2163,7 @@ void update()
                     if (bb_new.x2 < bb_new.x1) std::swap(bb_new.x1, bb_new.x2);
                     if (bb_new.y2 < bb_new.y1) std::swap(bb_new.y1, bb_new.y2);
                     map_state->bbs.push_back((const bb_t&)bb_new);
+                    map_state->bb_index.invalidate();
                     map_state->selected_bb = (int)map_state->bbs.size() - 1;
                     push_undo();
                 }
@@ -1405,11 +2197,13 @@ void update()
                     sel_bb.y2 = bb_on_down.y2 - (int)diff.y;
                     break;
             }
+            map_state->bb_index.moved(map_state->bbs, map_state->selected_bb);
             if (OInputJustReleased(OMouse1))
             {
                 // If bounding box would be inverted, correct it
                 if (sel_bb.x2 < sel_bb.x1) std::swap(sel_bb.x1, sel_bb.x2);
                 if (sel_bb.y2 < sel_bb.y1) std::swap(sel_bb.y1, sel_bb.y2);
+                map_state->bb_index.invalidate(); // Repack now that it's in place
                 push_undo();
                 state = state_t::idle;
             }
@@ -1426,6 +2220,7 @@ void update()
                 rules->x = std::round(rules->x / 64) * 64;
                 rules->y = std::round(rules->y / 64) * 64;
             }
+            invalidate_rules_cache();
             if (OInputJustReleased(OMouse1))
             {
                 push_undo();
@@ -1486,6 +2281,7 @@ void update()
     
                             connection.target_region = mouse_hover_rule;
                             rules_from->connections.push_back(connection);
+                            invalidate_rules_cache();
                             push_undo();
 
                             set_rule_rule = connecting_rule_from;
@@ -1568,14 +2364,10 @@ void draw_guides()
 
 region_t* get_region_for_sector(map_state_t* map_state, int sector)
 {
-    for (auto& region : map_state->regions)
-    {
-        if (region.sectors.count(sector))
-        {
-            return &region;
-        }
-    }
-    return nullptr;
+    if (sector < 0 || sector >= (int)map_state->sector_region.size()) return nullptr;
+    int region = map_state->sector_region[sector];
+    if (region == -1) return nullptr;
+    return &map_state->regions[region];
 }
 
 
@@ -1585,7 +2377,7 @@ void draw_rules(const rule_region_t& rules, const region_t& region, bool mouse_h
 
     Rect rect(rules.x - RULES_W * 0.5f, -rules.y - RULES_H * 0.5f, RULES_W, RULES_H);
     sb->drawRect(nullptr, rect, Color(0, 0, 0, 0.75f));
-    sb->drawInnerOutlineRect(rect, 1.0f / map_view->cam_zoom * 2.0f, region.tint);
+    sb->drawInnerOutlineRect(rect, 1.0f / map_view->cam_zoom * 2.0f, to_color(region.tint));
     if (mouse_hover)
     {
         sb->drawInnerOutlineRect(rect.Grow(1.0f / map_view->cam_zoom * 2.0f), 1.0f / map_view->cam_zoom * 2.0f, Color(0, 1, 1));
@@ -1601,7 +2393,7 @@ void draw_rules_name(const rule_region_t& rules, const region_t& region)
     sb->begin(
         Matrix::CreateScale(10.0f) * 
         Matrix::CreateTranslation(Vector2(rules.x, -rules.y)) *
-        Matrix::Create2DTranslationZoom(OScreenf, map_view->cam_pos, map_view->cam_zoom)
+        Matrix::Create2DTranslationZoom(OScreenf, to_vector2(map_view->cam_pos), map_view->cam_zoom)
     );
     sb->drawText(pFont, region.name, Vector2::Zero, OCenter, Color::White);
     sb->end();
@@ -1611,23 +2403,19 @@ void draw_rules_name(const rule_region_t& rules, const region_t& region)
 void draw_connections(const rule_region_t& rules, int rule_idx)
 {
     auto pb = oPrimitiveBatch.get();
+    const auto& cache = get_rules_cache();
 
     Vector2 center((float)rules.x, -(float)rules.y);
 
-    int i = 0;
-    for (const auto& connection : rules.connections)
+    int slot = get_rule_slot(rule_idx);
+    for (int s = cache.segment_offsets[slot]; s < cache.segment_offsets[slot + 1]; ++s)
     {
-        auto other_rules = get_rules(connection.target_region);
-        if (!other_rules) continue;
-        Rect other_rect(other_rules->x - RULES_W * 0.5f, -other_rules->y - RULES_H * 0.5f, RULES_W, RULES_H);
-        other_rect.Grow(128);
-
-        Vector2 other_center((float)other_rules->x, -(float)other_rules->y);
-        Vector2 from = get_rect_edge_pos(center, other_center, RULE_CONNECTION_OFFSET, false);
-        Vector2 to = get_rect_edge_pos(other_center, center, RULE_CONNECTION_OFFSET, true);
-        Vector2 dir = to - from;
-        dir.Normalize();
-        Vector2 right(-dir.y, dir.x);
+        const auto& segment = cache.segments[s];
+        const auto& from = segment.from;
+        const auto& to = segment.to;
+        const auto& dir = segment.dir;
+        const auto& right = segment.right;
+        int i = segment.connection;
 
         Color color = Color::White;
         if (mouse_hover_connection_rule == rule_idx && i == mouse_hover_connection)
@@ -1642,8 +2430,6 @@ void draw_connections(const rule_region_t& rules, int rule_idx)
         pb->draw(from, color); pb->draw(to, color);
         pb->draw(to, color); pb->draw(to - dir * 32.0f - right * 32.0f, color);
         pb->draw(to, color); pb->draw(to - dir * 32.0f + right * 32.0f, color);
-
-        ++i;
     }
 
     if (state == state_t::connecting_rule &&
@@ -1685,10 +2471,9 @@ void draw_connections(const rule_region_t& rules, int rule_idx)
 
 OTextureRef get_requirement_icon(game_t* game, int doom_type)
 {
-    for (const auto& requirement : game->item_requirements)
-        if (requirement.doom_type == doom_type)
-            return requirement.icon;
-    return nullptr;
+    int requirement = game->doom_types[doom_type].item_requirement;
+    if (requirement == -1) return nullptr;
+    return item_icons[game->short_name][requirement];
 }
 
 
@@ -1703,23 +2488,17 @@ void draw_connections_requirements(const rule_region_t& rules, int rule_idx)
 {
     auto sb = oSpriteBatch.get();
     auto game = get_game(active_level);
+    const auto& cache = get_rules_cache();
 
-    Vector2 center((float)rules.x, -(float)rules.y);
-
-    int i = 0;
-    for (const auto& connection : rules.connections)
+    int slot = get_rule_slot(rule_idx);
+    for (int s = cache.segment_offsets[slot]; s < cache.segment_offsets[slot + 1]; ++s)
     {
-        auto other_rules = get_rules(connection.target_region);
-        if (!other_rules) continue;
-        Rect other_rect(other_rules->x - RULES_W * 0.5f, -other_rules->y - RULES_H * 0.5f, RULES_W, RULES_H);
-        other_rect.Grow(128);
-
-        Vector2 other_center((float)other_rules->x, -(float)other_rules->y);
-        Vector2 from = get_rect_edge_pos(center, other_center, RULE_CONNECTION_OFFSET, false);
-        Vector2 to = get_rect_edge_pos(other_center, center, RULE_CONNECTION_OFFSET, true);
-        Vector2 dir = to - from;
-        dir.Normalize();
-        Vector2 right(-dir.y, dir.x);
+        const auto& segment = cache.segments[s];
+        const auto& connection = rules.connections[segment.connection];
+        const auto& from = segment.from;
+        const auto& to = segment.to;
+        const auto& dir = segment.dir;
+        const auto& right = segment.right;
 
         auto count = connection.requirements_or.size() + connection.requirements_and.size();
         Vector2 pos = (to - from) * 0.5f + right * REQUIREMENT_SIZE - dir * ((float)(count) * 0.5f * REQUIREMENT_SIZE - 0.5f * REQUIREMENT_SIZE);
@@ -1735,8 +2514,6 @@ void draw_connections_requirements(const rule_region_t& rules, int rule_idx)
             sb->drawSprite(tex, pos + from, Color::White, 0.0f, get_sprite_scale(tex));
             pos += dir * REQUIREMENT_SIZE;
         }
-
-        ++i;
     }
 }
 
@@ -1748,7 +2525,7 @@ void draw_rules()
     auto sb = oSpriteBatch.get();
     auto pb = oPrimitiveBatch.get();
 
-    auto transform = Matrix::Create2DTranslationZoom(OScreenf, map_view->cam_pos, map_view->cam_zoom);
+    auto transform = Matrix::Create2DTranslationZoom(OScreenf, to_vector2(map_view->cam_pos), map_view->cam_zoom);
 
     // Draw connections
     pb->begin(OPrimitiveLineList, nullptr, transform);
@@ -1813,25 +2590,49 @@ void draw_level(const level_index_t& idx, const Vector2& pos, float angle, bool
     auto transform = 
               Matrix::CreateRotationZ(angle) *
               Matrix::CreateTranslation(Vector2(pos.x, -pos.y)) *
-              Matrix::Create2DTranslationZoom(OScreenf, map_view->cam_pos, map_view->cam_zoom);
+              Matrix::Create2DTranslationZoom(OScreenf, to_vector2(map_view->cam_pos), map_view->cam_zoom);
+
+    // Visible area, in map space. Only what overlaps it gets drawn.
+    int view_x1, view_y1, view_x2, view_y2;
+    {
+        auto inv_transform = transform.Invert();
+        Vector2 corners[4] = {
+            Vector2::Transform(Vector2(0, 0), inv_transform),
+            Vector2::Transform(Vector2(OScreenf.x, 0), inv_transform),
+            Vector2::Transform(Vector2(0, OScreenf.y), inv_transform),
+            Vector2::Transform(OScreenf, inv_transform)
+        };
+        Vector2 view_min = corners[0];
+        Vector2 view_max = corners[0];
+        for (int c = 1; c < 4; ++c)
+        {
+            view_min = onut::min(view_min, corners[c]);
+            view_max = onut::max(view_max, corners[c]);
+        }
+        view_x1 = (int)std::floor(view_min.x) - 1;
+        view_y1 = (int)std::floor(-view_max.y) - 1;
+        view_x2 = (int)std::ceil(view_max.x) + 1;
+        view_y2 = (int)std::ceil(-view_min.y) + 1;
+    }
+    static std::vector<int> visible;
 
     // Sectors
     if (draw_tools)
     {
         pb->begin(OPrimitiveTriangleList, nullptr, transform);
-        int i = 0;
-        for (const auto& sector : map->sectors)
+        query_grid(map->sector_grid, view_x1, view_y1, view_x2, view_y2, visible);
+        for (int sectori : visible)
         {
-            region_t* region = get_region_for_sector(map_state, i);
+            const auto& sector = map->sectors[sectori];
+            region_t* region = get_region_for_sector(map_state, sectori);
             if (region)
             {
-                Color color = region->tint * 0.5f;
+                Color color = to_color(region->tint) * 0.5f;
                 for (int i = 0, len = (int)sector.triangle_vertices.size(); i < len; ++i)
                 {
-                    pb->draw(sector.triangle_vertices[i], color);
+                    pb->draw(to_vector2(sector.triangle_vertices[i]), color);
                 }
             }
-            ++i;
         }
         pb->end();
     }
@@ -1840,10 +2641,11 @@ void draw_level(const level_index_t& idx, const Vector2& pos, float angle, bool
     pb->begin(OPrimitiveLineList, nullptr, transform);
 
     // Geometry
-    int i = 0;
     bool is_heretic = game->iwad_name == "HERETIC.WAD";
-    for (const auto& line : map->linedefs)
+    query_grid(map->linedef_grid, view_x1, view_y1, view_x2, view_y2, visible);
+    for (int linei : visible)
     {
+        const auto& line = map->linedefs[linei];
         Color color = bound_color;
         if (line.back_sidedef != -1) color = step_color;
 
@@ -1855,17 +2657,17 @@ void draw_level(const level_index_t& idx, const Vector2& pos, float angle, bool
                     line.special_type == LT_D1_DOOR_RED_OPEN_STAY ||
                     line.special_type == LT_SR_DOOR_RED_OPEN_STAY_FAST ||
                     line.special_type == LT_S1_DOOR_RED_OPEN_STAY_FAST)
-                    color = game->key_colors[1];
+                    color = to_color(game->key_colors[1]);
                 else if (line.special_type == LT_DR_DOOR_YELLOW_OPEN_WAIT_CLOSE ||
                     line.special_type == LT_D1_DOOR_YELLOW_OPEN_STAY ||
                     line.special_type == LT_SR_DOOR_YELLOW_OPEN_STAY_FAST ||
                     line.special_type == LT_S1_DOOR_YELLOW_OPEN_STAY_FAST)
-                    color = game->key_colors[0];
+                    color = to_color(game->key_colors[0]);
                 else if (line.special_type == LT_DR_DOOR_BLUE_OPEN_WAIT_CLOSE ||
                     line.special_type == LT_D1_DOOR_BLUE_OPEN_STAY ||
                     line.special_type == LT_SR_DOOR_BLUE_OPEN_STAY_FAST ||
                     line.special_type == LT_S1_DOOR_BLUE_OPEN_STAY_FAST)
-                    color = game->key_colors[2];
+                    color = to_color(game->key_colors[2]);
             }
             else
             {
@@ -1873,17 +2675,17 @@ void draw_level(const level_index_t& idx, const Vector2& pos, float angle, bool
                     line.special_type == LT_D1_DOOR_RED_OPEN_STAY ||
                     line.special_type == LT_SR_DOOR_RED_OPEN_STAY_FAST ||
                     line.special_type == LT_S1_DOOR_RED_OPEN_STAY_FAST)
-                    color = game->key_colors[2];
+                    color = to_color(game->key_colors[2]);
                 else if (line.special_type == LT_DR_DOOR_YELLOW_OPEN_WAIT_CLOSE ||
                     line.special_type == LT_D1_DOOR_YELLOW_OPEN_STAY ||
                     line.special_type == LT_SR_DOOR_YELLOW_OPEN_STAY_FAST ||
                     line.special_type == LT_S1_DOOR_YELLOW_OPEN_STAY_FAST)
-                    color = game->key_colors[1];
+                    color = to_color(game->key_colors[1]);
                 else if (line.special_type == LT_DR_DOOR_BLUE_OPEN_WAIT_CLOSE ||
                     line.special_type == LT_D1_DOOR_BLUE_OPEN_STAY ||
                     line.special_type == LT_SR_DOOR_BLUE_OPEN_STAY_FAST ||
                     line.special_type == LT_S1_DOOR_BLUE_OPEN_STAY_FAST)
-                    color = game->key_colors[0];
+                    color = to_color(game->key_colors[0]);
             }
 
             if (line.special_type == LT_DR_DOOR_OPEN_WAIT_CLOSE_ALSO_MONSTERS ||
@@ -1929,13 +2731,13 @@ void draw_level(const level_index_t& idx, const Vector2& pos, float angle, bool
         
         pb->draw(Vector2(map->vertexes[line.start_vertex].x, -map->vertexes[line.start_vertex].y), color);
         pb->draw(Vector2(map->vertexes[line.end_vertex].x, -map->vertexes[line.end_vertex].y), color);
-
-        ++i;
     }
 
-    // Arrows
-    for (const auto& arrow : map->arrows)
+    // Arrows (heads stick out a bit past their line)
+    query_grid(map->arrow_grid, view_x1 - 16, view_y1 - 16, view_x2 + 16, view_y2 + 16, visible);
+    for (int arrowi : visible)
     {
+        const auto& arrow = map->arrows[arrowi];
         switch (arrow.type)
         {
         case ARROW_DOOR_SR:  // fall through
@@ -1948,16 +2750,19 @@ void draw_level(const level_index_t& idx, const Vector2& pos, float angle, bool
         default: break;
         }
 
-        pb->draw(arrow.from, arrow.color);
-        pb->draw(arrow.to, arrow.color);
+        Vector2 from = to_vector2(arrow.from);
+        Vector2 to = to_vector2(arrow.to);
+        Color color = to_color(arrow.color);
+        pb->draw(from, color);
+        pb->draw(to, color);
 
-        Vector2 dir = arrow.to - arrow.from;
+        Vector2 dir = to - from;
         dir.Normalize();
         Vector2 right(-dir.y, dir.x);
 
 #define ARROW_HEAD_SIZE 8.0f
-        pb->draw(arrow.to, arrow.color); pb->draw(arrow.to - dir * ARROW_HEAD_SIZE - right * ARROW_HEAD_SIZE, arrow.color);
-        pb->draw(arrow.to, arrow.color); pb->draw(arrow.to - dir * ARROW_HEAD_SIZE + right * ARROW_HEAD_SIZE, arrow.color);
+        pb->draw(to, color); pb->draw(to - dir * ARROW_HEAD_SIZE - right * ARROW_HEAD_SIZE, color);
+        pb->draw(to, color); pb->draw(to - dir * ARROW_HEAD_SIZE + right * ARROW_HEAD_SIZE, color);
     }
 
     pb->end();
@@ -1979,7 +2784,7 @@ void draw_level(const level_index_t& idx, const Vector2& pos, float angle, bool
     for (const auto& bb : map_state->bbs)
     {
         Color color = bb_color;
-        if (bb.region > -1 && bb.region < (int)map_state->regions.size()) color = map_state->regions[bb.region].tint;
+        if (bb.region > -1 && bb.region < (int)map_state->regions.size()) color = to_color(map_state->regions[bb.region].tint);
         sb->drawOutterOutlineRect(Rect(bb.x1, -bb.y1 - (bb.y2 - bb.y1), bb.x2 - bb.x1, bb.y2 - bb.y1), 2.0f / map_view->cam_zoom, color);
     }
     sb->end();
@@ -2023,12 +2828,12 @@ void draw_level(const level_index_t& idx, const Vector2& pos, float angle, bool
     // Items
     sb->begin(transform);
     oRenderer->renderStates.sampleFiltering = OFilterNearest;
-    i = -1;
-    for (const auto& thing : map->things)
+    query_grid(map->thing_grid, view_x1 - 128, view_y1 - 128, view_x2 + 128, view_y2 + 128, visible); // Icons are drawn larger than the things
+    for (int i : visible)
     {
-        ++i;
+        const auto& thing = map->things[i];
         if (thing.flags & THING_FLAG_MP_ONLY) continue; // Thing is not in single player
-        if (game->location_doom_types.find(thing.type) != game->location_doom_types.end())
+        if (game->doom_types[thing.type].is_location())
         {
             //ap_deathlogic_icon
             if (map_state->locations[i].death_logic)
@@ -2040,14 +2845,9 @@ void draw_level(const level_index_t& idx, const Vector2& pos, float angle, bool
             else if (map_state->locations[i].check_sanity)
                 sb->drawSprite(ap_check_sanity_icon, Vector2(thing.x, -thing.y), Color::White, 0.0f, 1.0f);
 
-            for (const auto& bb : map_state->bbs)
-            {
-                if (bb.region > -1 && bb.region < (int)map_state->regions.size() && bb.point_inside(thing.x, thing.y))
-                {
-                    sb->drawSprite(ap_region_override_icon, Vector2(thing.x, -thing.y), map_state->regions[bb.region].tint, 0.0f, 1.0f);
-                    break;
-                }
-            }
+            int override_bb = map_state->get_override_bb_at(thing.x, thing.y);
+            if (override_bb != -1)
+                sb->drawSprite(ap_region_override_icon, Vector2(thing.x, -thing.y), to_color(map_state->regions[map_state->bbs[override_bb].region].tint), 0.0f, 1.0f);
         }
         else if (thing.type == 1) // Player start
         {
@@ -2073,7 +2873,7 @@ void render()
     auto pb = oPrimitiveBatch.get();
     auto sb = oSpriteBatch.get();
 
-    pb->begin(OPrimitiveLineList, nullptr, Matrix::Create2DTranslationZoom(OScreenf, map_view->cam_pos, map_view->cam_zoom));
+    pb->begin(OPrimitiveLineList, nullptr, Matrix::Create2DTranslationZoom(OScreenf, to_vector2(map_view->cam_pos), map_view->cam_zoom));
     draw_guides();
     pb->end();
 
@@ -2165,6 +2965,91 @@ static ImVec2 SizeVec(float x, float y)
     return ImVec2((x * xscale) - 1.0f, (y * yscale) - 1.0f);
 }
 
+// What changed in a level since it was saved, worked out when the Diff menu is opened
+static std::vector<std::string> diff_level_states(const map_state_t& saved, const map_state_t& current)
+{
+    std::vector<std::string> changes;
+
+    std::map<std::string, const region_t*> saved_regions; // By name
+    for (const auto& region : saved.regions)
+        saved_regions[region.name] = &region;
+    for (const auto& region : current.regions)
+    {
+        auto it = saved_regions.find(region.name);
+        if (it == saved_regions.end())
+        {
+            changes.push_back("Added region '" + region.name + "'");
+            continue;
+        }
+        const auto& saved_region = *it->second;
+        saved_regions.erase(it);
+
+        int added = 0, removed = 0;
+        for (int sector : region.sectors)
+            if (!saved_region.sectors.count(sector)) ++added;
+        for (int sector : saved_region.sectors)
+            if (!region.sectors.count(sector)) ++removed;
+        if (added || removed)
+            changes.push_back("Region '" + region.name + "': +" + std::to_string(added) + " / -" + std::to_string(removed) + " sectors");
+        if (!(region.rules == saved_region.rules))
+            changes.push_back("Region '" + region.name + "': rules changed");
+        if (!(region.tint == saved_region.tint))
+            changes.push_back("Region '" + region.name + "': tint changed");
+    }
+    for (const auto& kv : saved_regions)
+        changes.push_back("Removed region '" + kv.first + "'");
+
+    if (!(current.world_rules == saved.world_rules))
+        changes.push_back("World rules changed");
+    if (!(current.exit_rules == saved.exit_rules))
+        changes.push_back("Exit rules changed");
+    if (!(current.bbs == saved.bbs))
+        changes.push_back("Bounding boxes: " + std::to_string(saved.bbs.size()) + " -> " + std::to_string(current.bbs.size()));
+    if (!(current.accesses == saved.accesses))
+        changes.push_back("Accesses changed");
+
+    int locations_changed = 0;
+    for (const auto& kv : current.locations)
+    {
+        auto it = saved.locations.find(kv.first);
+        if (it == saved.locations.end() || !(it->second == kv.second))
+            ++locations_changed;
+    }
+    if (locations_changed)
+        changes.push_back(std::to_string(locations_changed) + " location(s) changed");
+
+    return changes;
+}
+
+
+static const std::vector<std::string>& get_level_diff()
+{
+    static level_index_t diff_level;
+    static uint64_t diff_state_hash = 0;
+    static uint64_t diff_saved_hash = 0;
+    static std::vector<std::string> changes;
+
+    auto meta = get_meta(active_level);
+    if (!meta || !meta->different())
+    {
+        changes.clear();
+        diff_level = {};
+        return changes;
+    }
+    if (diff_level == active_level && diff_state_hash == meta->state_hash && diff_saved_hash == meta->saved_hash)
+        return changes;
+
+    refresh_saved_state(active_level);
+    changes = diff_level_states(meta->state_new, meta->state);
+    if (changes.empty())
+        changes.push_back("Changed"); // Only in ways that aren't listed, like the order of things
+    diff_level = active_level;
+    diff_state_hash = meta->state_hash;
+    diff_saved_hash = meta->saved_hash;
+    return changes;
+}
+
+
 static void renderGames(bool is_in_submenu)
 {
     for (auto& kv : games)
@@ -2184,7 +3069,6 @@ static void renderGames(bool is_in_submenu)
                 int map = 0;
                 for (const auto& meta : episode)
                 {
-                    auto map_state = &meta.state;
                     bool selected = &meta == get_meta(active_level);
                     if (ep != 0 && map == 0)
                     {
@@ -2197,7 +3081,7 @@ static void renderGames(bool is_in_submenu)
                     episode_check_sanity_count += meta.state.check_sanity_count;
                     std::string displayed_checks = std::to_string(meta.map.check_count) + "-" + std::to_string(meta.state.check_sanity_count) + "=(" + std::to_string(meta.map.check_count - meta.state.check_sanity_count) + ")";
 
-                    if (ImGui::MenuItem((meta.name + (map_state->different ? "*" : "")).c_str(), displayed_checks.c_str(), &selected))
+                    if (ImGui::MenuItem((meta.name + (meta.different() ? "*" : "")).c_str(), displayed_checks.c_str(), &selected))
                         select_map(game, ep, map);
                     ++map;
                 }
@@ -2207,6 +3091,39 @@ static void renderGames(bool is_in_submenu)
             ImGui::EndMenu();
         }
     }
+
+    // Listed but not loaded yet, the level names are known from the catalog
+    for (auto& kv : game_catalog)
+    {
+        auto& entry = kv.second;
+        if (entry.state == catalog_state_t::loaded)
+            continue;
+        if (!is_in_submenu)
+            ImGui::Separator();
+
+        std::string label = entry.full_name;
+        if (entry.state == catalog_state_t::loading)
+            label += " (loading...)";
+        else if (!entry.missing_wad.empty())
+            label += " (missing " + entry.missing_wad + ")";
+        else if (entry.state == catalog_state_t::failed)
+            label += " (failed)";
+
+        if (ImGui::BeginMenu((label + "##" + kv.first).c_str()))
+        {
+            bool can_load = entry.state == catalog_state_t::listed && entry.missing_wad.empty();
+            if (ImGui::MenuItem("Load", nullptr, false, can_load))
+                request_game_load(kv.first, false);
+            for (size_t ep = 0; ep < entry.episode_names.size(); ++ep)
+            {
+                ImGui::Separator();
+                ImGui::TextColored(ImVec4(0.6f, 0.6f, 0.6f, 1.0f), "%s", entry.episode_names[ep].c_str());
+                for (const auto& map_name : entry.map_names[ep])
+                    ImGui::MenuItem(map_name.c_str(), nullptr, false, false);
+            }
+            ImGui::EndMenu();
+        }
+    }
 }
 
 void renderUI()
@@ -2230,19 +3147,53 @@ void renderUI()
         else if (ImGui::MenuItem(("Save " + get_game(active_level)->full_name).c_str(), "Ctrl+S"))
             save(get_game(active_level));
 
+        if (ImGui::BeginMenu("Autosave"))
+        {
+            static const int autosave_choices[] = {0, 1, 5, 10, 30};
+            for (int minutes : autosave_choices)
+            {
+                std::string label = minutes ? "Every " + std::to_string(minutes) + (minutes == 1 ? " Minute" : " Minutes") : "Off";
+                if (ImGui::MenuItem(label.c_str(), "", autosave_minutes == minutes))
+                {
+                    autosave_minutes = minutes;
+                    last_autosave = std::chrono::steady_clock::now();
+                    oSettings->setUserSetting("autosave_minutes", std::to_string(minutes));
+                }
+            }
+            ImGui::EndMenu();
+        }
+
         ImGui::Separator();
 
         if (ImGui::BeginMenu("Generate APWorld..."))
         {
-            if (games.empty())
+            if (game_catalog.empty())
                 ImGui::MenuItem("No games are loaded", NULL, false, false);
-            else for (auto& kv : games)
+            else
+            {
+                if (ImGui::MenuItem(generate_all_pending ? "Generate All (loading...)" : "Generate All", nullptr, false, !generate_all_pending))
+                    request_generate_all();
+                ImGui::Separator();
+            }
+            for (auto& kv : game_catalog)
             {
-                auto game = &kv.second;
-                if (ImGui::MenuItem(("Generate " + game->full_name).c_str()))
+                auto& entry = kv.second;
+                auto it = games.find(kv.first);
+                if (it != games.end())
                 {
-                    save(game);
-                    generate(game);
+                    auto game = &it->second;
+                    if (ImGui::MenuItem(("Generate " + game->full_name).c_str()))
+                    {
+                        save(game);
+                        generate(game);
+                    }
+                }
+                else if (entry.missing_wad.empty() && entry.state != catalog_state_t::failed)
+                {
+                    // Loads it first, then generates
+                    bool pending = entry.state == catalog_state_t::loading && entry.generate_when_loaded;
+                    if (ImGui::MenuItem(("Generate " + entry.full_name + (pending ? " (loading...)" : "")).c_str(), nullptr, false, !pending))
+                        request_game_load(kv.first, true);
                 }
             }
             ImGui::EndMenu();
@@ -2265,6 +3216,17 @@ void renderUI()
         if (ImGui::MenuItem("Access",       "5", tool == tool_t::access))    tool = tool_t::access;
 #endif
 
+        ImGui::Separator();
+        if (ImGui::BeginMenu("Flood Fill Stops At"))
+        {
+            if (ImGui::MenuItem("Doors", "",          flood_fill_stop & EDGE_DOOR))        flood_fill_stop ^= EDGE_DOOR;
+            if (ImGui::MenuItem("Locked Doors", "",   flood_fill_stop & EDGE_LOCKED_DOOR)) flood_fill_stop ^= EDGE_LOCKED_DOOR;
+            if (ImGui::MenuItem("Lifts", "",          flood_fill_stop & EDGE_LIFT))        flood_fill_stop ^= EDGE_LIFT;
+            if (ImGui::MenuItem("Teleporters", "",    flood_fill_stop & EDGE_TELEPORT))    flood_fill_stop ^= EDGE_TELEPORT;
+            if (ImGui::MenuItem("Other Specials", "", flood_fill_stop & EDGE_OTHER))       flood_fill_stop ^= EDGE_OTHER;
+            ImGui::EndMenu();
+        }
+
         ImGui::EndMenu();
     }
 
@@ -2300,39 +3262,46 @@ void renderUI()
         {
             bool selected = active_source == active_source_t::current;
             if (ImGui::MenuItem("Show Current", "F1", &selected, game_loaded))
-            {
-                active_source = active_source_t::current;
-                map_state = get_state(active_level, active_source);
-            }
+                show_source(active_source_t::current);
         }
         {
             bool selected = active_source == active_source_t::target;
             if (ImGui::MenuItem("Show Target", "F2", &selected, game_loaded))
-            {
-                active_source = active_source_t::target;
-                map_state = get_state(active_level, active_source);
-            }
+                show_source(active_source_t::target);
         }
         ImGui::Separator();
-        if (ImGui::MenuItem("Apply Target", NULL, false, game_loaded))
+        if (ImGui::MenuItem("Apply Target", NULL, false, game_loaded && get_meta(active_level)->different()))
         {
-            *get_state(active_level, active_source_t::current) = *get_state(active_level, active_source_t::target);
-            map_state = get_state(active_level);
+            // Back to the current version first, so its state before this can be undone to
+            refresh_saved_state(active_level);
+            show_source(active_source_t::current);
+            *map_state = *get_state(active_level, active_source_t::target);
+            invalidate_rules_cache();
             push_undo();
         }
+        if (game_loaded)
+        {
+            ImGui::Separator();
+            const auto& changes = get_level_diff();
+            if (changes.empty())
+                ImGui::MenuItem("No changes since saved", NULL, false, false);
+            for (const auto& change : changes)
+                ImGui::MenuItem(change.c_str(), NULL, false, false);
+        }
         ImGui::EndMenu();
     }
 
     ImGui::Separator();
     ImVec4 info_colored(0.6f, 0.6f, 0.6f, 1.0f);
 
-    if (games.size() > 0)
+    // Every loaded game is also in the catalog
+    if (game_catalog.size() > 0)
         ImGui::TextColored(info_colored, "Maps:");
 
-    if (games.size() >= 8)
+    if (game_catalog.size() >= 8)
     {
         // If the game list gets too large, we need to make a new menu for it.
-        if (ImGui::BeginMenu(("All Loaded Games (" + std::to_string(games.size()) + ")").c_str()))
+        if (ImGui::BeginMenu(("All Games (" + std::to_string(games.size()) + "/" + std::to_string(game_catalog.size()) + " loaded)").c_str()))
         {
             renderGames(true);
             ImGui::EndMenu();
@@ -2363,6 +3332,7 @@ void renderUI()
                 region_t region;
                 region.name = region_name;
                 map_state->regions.push_back(region);
+                invalidate_rules_cache();
                 region_name[0] = '\0';
                 map_state->selected_region = (int)map_state->regions.size() - 1;
                 push_undo();
@@ -2387,6 +3357,7 @@ void renderUI()
                             if (ImGui::Button("Assign"))
                             {
                                 map_state->bbs[map_state->selected_bb].region = i;
+                                push_undo();
                             }
                         }
                         else
@@ -2410,6 +3381,8 @@ void renderUI()
                     map_state->regions.erase(map_state->regions.begin() + to_move_up);
                     map_state->regions.insert(map_state->regions.begin() + (to_move_up - 1), region);
                     map_state->selected_region = to_move_up - 1;
+                    map_state->rebuild_sector_regions((int)get_map(active_level)->sectors.size());
+                    invalidate_rules_cache();
                     push_undo();
                 }
                 if (to_move_down != -1 && to_move_down < (int)map_state->regions.size() - 1)
@@ -2425,6 +3398,8 @@ void renderUI()
                     map_state->regions.erase(map_state->regions.begin() + to_move_down);
                     map_state->regions.insert(map_state->regions.begin() + (to_move_down + 1), region);
                     map_state->selected_region = to_move_down + 1;
+                    map_state->rebuild_sector_regions((int)get_map(active_level)->sectors.size());
+                    invalidate_rules_cache();
                     push_undo();
                 }
                 if (to_delete != -1)
@@ -2453,6 +3428,8 @@ void renderUI()
                     }
                     map_state->regions.erase(map_state->regions.begin() + to_delete);
                     map_state->selected_region = onut::min((int)map_state->regions.size() - 1, map_state->selected_region);
+                    map_state->rebuild_sector_regions((int)get_map(active_level)->sectors.size());
+                    invalidate_rules_cache();
                     push_undo();
                 }
             }
@@ -2493,6 +3470,7 @@ void renderUI()
                     if (ImGui::Button("Remove"))
                     {
                         rules->connections.erase(rules->connections.begin() + set_rule_connection);
+                        invalidate_rules_cache();
                         set_rule_rule = -3;
                         set_rule_connection = -1;
                         push_undo();
@@ -2510,10 +3488,13 @@ void renderUI()
                         ImGui::Text("AND");
                         ImGui::NextColumn();
 
-                        for (const auto& requirement : game->item_requirements)
+                        const auto& icons = item_icons[game->short_name];
+                        for (int requirementi = 0; requirementi < (int)game->item_requirements.size(); ++requirementi)
                         {
-                            float biggest = requirement.icon->getSizef().x;
-                            ImVec2 img_scale(requirement.icon->getSizef().x / biggest * 64.0f, requirement.icon->getSizef().y / biggest * 64.0f);
+                            const auto& requirement = game->item_requirements[requirementi];
+                            const auto& icon = icons[requirementi];
+                            float biggest = icon->getSizef().x;
+                            ImVec2 img_scale(icon->getSizef().x / biggest * 64.0f, icon->getSizef().y / biggest * 64.0f);
 
                             // Extra requirements are AND only, they don't function in OR slots, so hide them
                             if (requirement.doom_type > 0)
@@ -2529,7 +3510,7 @@ void renderUI()
 
                                 if (ImGui::ImageButton(
                                     ("or_btn_" + std::to_string(requirement.doom_type)).c_str(), // str_id
-                                    (ImTextureID)&requirement.icon, // user_texture_id
+                                    (ImTextureID)&icon, // user_texture_id
                                     img_scale, // size
                                     ImVec2(0, 0), // uv0
                                     ImVec2(1, 1), // uv1
@@ -2561,7 +3542,7 @@ void renderUI()
                                 }
                                 if (ImGui::ImageButton(
                                     ("and_btn_" + std::to_string(requirement.doom_type)).c_str(), // str_id
-                                    (ImTextureID)&requirement.icon, // user_texture_id
+                                    (ImTextureID)&icon, // user_texture_id
                                     img_scale, // size
                                     ImVec2(0, 0), // uv0
                                     ImVec2(1, 1), // uv1
@@ -2620,7 +3601,7 @@ void renderUI()
                         map_state->selected_location = index;
                     }
                 }
-                if (game->location_doom_types.find(thing.type) != game->location_doom_types.end())
+                if (game->doom_types[thing.type].is_location())
                 {
                     if (map_state->locations[index].unreachable)
                     {
@@ -2702,7 +3683,7 @@ void renderUI()
     }
 
     // Display text
-    OnScreenMessages::Render();
+    OnScreenMessagesUI::Render();
 }
 
 
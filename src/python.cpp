@@ -5,8 +5,6 @@
 #include "data.h"
 #include "python.hpp"
 
-static bool vendored_id1common = false;
-
 static std::string Py_AutoGenHeader(const std::string &game_name)
 {
     std::stringstream header;
@@ -18,7 +16,7 @@ static std::string Py_AutoGenHeader(const std::string &game_name)
     return header.str();
 }
 
-static std::string Py_id1Common(const std::string &import)
+static std::string Py_id1Common(const std::string &import, bool vendored_id1common)
 {
     std::stringstream header;
     if (vendored_id1common)
@@ -76,23 +74,15 @@ std::string Py_QuoteString(const std::string& str)
 
 // ============================================================================
 
-std::stringstream pystream;
-
-void Py_SetCommonLibVendored(bool vendor)
+void Py_CreateInitPy(std::stringstream& pystream, game_t *game, const std::vector<WorldOption*>& world_options,
+    bool include_tutorials, bool vendored_id1common)
 {
-    vendored_id1common = vendor;
-}
-
-std::stringstream& Py_CreateInitPy(game_t *game, bool include_tutorials)
-{
-	pystream.str("");
-	pystream.clear();
 
     pystream << Py_AutoGenHeader(game->ap_name);
     pystream << "import typing" << std::endl;
     pystream << std::endl;
     pystream << "import BaseClasses as AP  # noqa: N814" << std::endl;
-    pystream << Py_id1Common("import id1CommonWorld");
+    pystream << Py_id1Common("import id1CommonWorld", vendored_id1common);
     pystream << "from worlds.AutoWorld import WebWorld" << std::endl;
     pystream << std::endl;
     pystream << "from .options import " << game->ap_class_name << "OptionGroups, " << game->ap_class_name << "Options" << std::endl;
@@ -138,14 +128,14 @@ std::stringstream& Py_CreateInitPy(game_t *game, bool include_tutorials)
     pystream << "    web = " << game->ap_class_name << "Web()" << std::endl;
     pystream << "    required_client_version = (0, 6, 3)  # APDoom version 2.0.0" << std::endl;
     pystream << std::endl;
-    pystream << Py_IndentJoin(WorldOptions_GetAllHooks(game, "class"), 4);
+    pystream << Py_IndentJoin(WorldOptions_GetAllHooks(game, world_options, "class"), 4);
 
     pystream << "    extra_connection_requirements = {" << std::endl;
     pystream << "        " << Py_QuoteString("deathlogic") << ": lambda self: self.options.allow_death_logic.value == 1," << std::endl;
     pystream << "        " << Py_QuoteString("trick_basic") << ": lambda self: self.options.trick_difficulty.value >= 1," << std::endl;
     pystream << "        " << Py_QuoteString("trick_pro") << ": lambda self: self.options.trick_difficulty.value >= 2," << std::endl;
     pystream << "        " << Py_QuoteString("trick_extreme") << ": lambda self: self.options.trick_difficulty.value >= 3," << std::endl;
-    pystream << Py_IndentJoin(WorldOptions_GetAllHooks(game, "extra_connection_requirements", 0), 8);
+    pystream << Py_IndentJoin(WorldOptions_GetAllHooks(game, world_options, "extra_connection_requirements", 0), 8);
     pystream << "    }" << std::endl;
     pystream << std::endl;
 
@@ -154,25 +144,25 @@ std::stringstream& Py_CreateInitPy(game_t *game, bool include_tutorials)
     pystream << "        item_data = self.item_table[item_id]" << std::endl;
     pystream << "        classification = item_data.classification" << std::endl;
     pystream << std::endl;
-    pystream << Py_IndentJoin(WorldOptions_GetAllHooks(game, "create_item"), 8);
+    pystream << Py_IndentJoin(WorldOptions_GetAllHooks(game, world_options, "create_item"), 8);
     pystream << "        return " << game->ap_class_name << "Item(name, classification, item_id, self.player)" << std::endl;
     pystream << std::endl;
 
     pystream << "    def generate_early(self) -> None:" << std::endl;
     pystream << "        self.init_episodes()" << std::endl;
     pystream << std::endl;
-    pystream << Py_IndentJoin(WorldOptions_GetAllHooks(game, "generate_early"), 8);
+    pystream << Py_IndentJoin(WorldOptions_GetAllHooks(game, world_options, "generate_early"), 8);
 
     pystream << "    def create_regions(self) -> None:" << std::endl;
     pystream << "        self.construct_regions()" << std::endl;
     pystream << "        self.make_regions(location_type=" << game->ap_class_name << "Location)" << std::endl;
     pystream << std::endl;
-    pystream << Py_IndentJoin(WorldOptions_GetAllHooks(game, "create_regions"), 8);
+    pystream << Py_IndentJoin(WorldOptions_GetAllHooks(game, world_options, "create_regions"), 8);
 
     pystream << "    def set_rules(self) -> None:" << std::endl;
     pystream << "        self.make_rules()" << std::endl;
     pystream << std::endl;
-    pystream << Py_IndentJoin(WorldOptions_GetAllHooks(game, "set_rules"), 8);
+    pystream << Py_IndentJoin(WorldOptions_GetAllHooks(game, world_options, "set_rules"), 8);
 
     pystream << "    def create_items(self) -> None:" << std::endl;
     pystream << "        self.place_level_complete_items(item_type=" << game->ap_class_name << "Item)" << std::endl;
@@ -186,7 +176,7 @@ std::stringstream& Py_CreateInitPy(game_t *game, bool include_tutorials)
     pystream << "        map_items = [pop_from_pool(map_name) for map_name in self.starting_levels]" << std::endl;
     pystream << "        [self.multiworld.push_precollected(self.create_item(n)) for n in map_items if n is not None]" << std::endl;
     pystream << std::endl;
-    pystream << Py_IndentJoin(WorldOptions_GetAllHooks(game, "create_items"), 8);
+    pystream << Py_IndentJoin(WorldOptions_GetAllHooks(game, world_options, "create_items"), 8);
     pystream << "        # Fill remainder with filler, and submit" << std::endl;
     pystream << "        self.fill_item_pool(itempool, location_count)" << std::endl;
     pystream << "        self.multiworld.itempool.extend(self.create_item(item) for item in itempool)" << std::endl;
@@ -195,17 +185,13 @@ std::stringstream& Py_CreateInitPy(game_t *game, bool include_tutorials)
     pystream << "    def fill_slot_data(self) -> dict[str, typing.Any]:" << std::endl;
     pystream << "        slot_data = super().fill_slot_data()" << std::endl;
     pystream << std::endl;
-    pystream << Py_IndentJoin(WorldOptions_GetAllHooks(game, "fill_slot_data"), 8);
+    pystream << Py_IndentJoin(WorldOptions_GetAllHooks(game, world_options, "fill_slot_data"), 8);
     pystream << "        return slot_data" << std::endl;
     pystream << std::endl;
-
-    return pystream;
 }
 
-std::stringstream& Py_CreateOptionsPy(game_t *game, std::vector<PyOption> &opts)
+void Py_CreateOptionsPy(std::stringstream& pystream, game_t *game, std::vector<PyOption> &opts, bool vendored_id1common)
 {
-	pystream.str("");
-	pystream.clear();
 
     pystream << Py_AutoGenHeader(game->ap_name);
     pystream << "# Options docstrings may exceed the line length limit." << std::endl;
@@ -214,7 +200,7 @@ std::stringstream& Py_CreateOptionsPy(game_t *game, std::vector<PyOption> &opts)
     pystream << "from dataclasses import dataclass" << std::endl;
     pystream << std::endl;
     pystream << "import Options as BaseOptions" << std::endl;
-    pystream << Py_id1Common("import options as id1Options  # noqa: N812");
+    pystream << Py_id1Common("import options as id1Options  # noqa: N812", vendored_id1common);
     pystream << std::endl << std::endl;
 
     for (const auto& option : opts)
@@ -288,6 +274,4 @@ std::stringstream& Py_CreateOptionsPy(game_t *game, std::vector<PyOption> &opts)
     }
     pystream << "]" << std::endl;
     pystream << std::endl;
-
-    return pystream;
 }
\ No newline at end of file
@@ -230,13 +230,16 @@ public:
 };
 
 struct game_t;
+class WorldOption;
 
-extern void Py_SetCommonLibVendored(bool vendor);
-extern std::stringstream& Py_CreateInitPy(game_t *game, bool include_tutorials);
-extern std::stringstream& Py_CreateOptionsPy(game_t *game, std::vector<PyOption>& opts);
+extern void Py_CreateInitPy(std::stringstream& pystream, game_t *game, const std::vector<WorldOption*>& world_options,
+    bool include_tutorials, bool vendored_id1common);
+extern void Py_CreateOptionsPy(std::stringstream& pystream, game_t *game, std::vector<PyOption>& opts, bool vendored_id1common);
 
 // WorldOptions; it just winds up being most convenient to have these here
-extern int WorldOptions_Init(game_t *game);
-extern std::vector<std::string>& WorldOptions_GetAllHooks(game_t *game, const std::string& hook_type, int line_breaks = 1);
-extern void WorldOptions_MixinPyOptions(game_t *game, std::vector<PyOption>& opts);
-extern void WorldOptions_Deinit(void);
+// Each generation owns its own list of options, errors are returned instead of shown.
+extern int WorldOptions_Init(game_t *game, std::vector<WorldOption*>& world_options, std::vector<std::string>& errors);
+extern std::vector<std::string> WorldOptions_GetAllHooks(game_t *game, const std::vector<WorldOption*>& world_options,
+    const std::string& hook_type, int line_breaks = 1);
+extern void WorldOptions_MixinPyOptions(game_t *game, const std::vector<WorldOption*>& world_options, std::vector<PyOption>& opts);
+extern void WorldOptions_Deinit(std::vector<WorldOption*>& world_options);
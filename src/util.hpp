@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <ctype.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+// What the core needs from the platform: files, strings, logging and the command line.
+// It's kept apart from onut so the command line tool links without a window or renderer.
+
+// Command line arguments, without the program name. Set by main(), or from OArguments by the editor.
+inline std::vector<std::string> core_arguments;
+
+// The whole file, empty if it couldn't be read
+inline std::vector<uint8_t> read_file_data(const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file)
+        return {};
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+inline void log_info(const std::string& message)
+{
+    printf("%s\n", message.c_str());
+    fflush(stdout);
+}
+
+inline void log_warning(const std::string& message)
+{
+    fprintf(stderr, "WARNING: %s\n", message.c_str());
+}
+
+inline void log_error(const std::string& message)
+{
+    fprintf(stderr, "ERROR: %s\n", message.c_str());
+}
+
+// Parse errors are logged
+inline bool load_json_file(Json::Value& json, const std::string& filename)
+{
+    auto data = read_file_data(filename);
+    if (data.empty())
+    {
+        log_error("Can't read '" + filename + "'");
+        return false;
+    }
+
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    std::string errors;
+    if (!reader->parse((const char*)data.data(), (const char*)data.data() + data.size(), &json, &errors))
+    {
+        log_error("'" + filename + "': " + errors);
+        return false;
+    }
+    return true;
+}
+
+// Paths of the files directly in 'folder', sorted
+inline std::vector<std::string> find_files(const std::string& folder)
+{
+    std::vector<std::string> files;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(folder, ec))
+        if (entry.is_regular_file(ec))
+            files.push_back(entry.path().string());
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+inline bool create_folder(const std::string& folder)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(folder, ec);
+    return std::filesystem::is_directory(folder, ec);
+}
+
+inline std::string to_lower(std::string text)
+{
+    for (auto& c : text)
+        c = (char)tolower((unsigned char)c);
+    return text;
+}
+
+inline std::string to_upper(std::string text)
+{
+    for (auto& c : text)
+        c = (char)toupper((unsigned char)c);
+    return text;
+}
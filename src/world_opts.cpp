@@ -1,12 +1,11 @@
 #include <vector>
 #include <string>
 
-#include <onut/Log.h>
-#include <onut/Json.h>
+#include <json/json.h>
 
 #include "data.h"
 #include "python.hpp"
-#include "message.hpp"
+#include "util.hpp"
 
 static std::string to_snake_case(const std::string& name)
 {
@@ -546,11 +545,9 @@ public:
 // ============================================================================
 // ============================================================================
 
-static std::vector<WorldOption *> initialized_world_options;
-
-int WorldOptions_Init(game_t *game)
+int WorldOptions_Init(game_t *game, std::vector<WorldOption*>& world_options, std::vector<std::string>& errors)
 {
-    int errors = 0;
+    int error_count = 0;
 
     for (const Json::Value& option : game->json_world_options)
     {
@@ -575,24 +572,23 @@ int WorldOptions_Init(game_t *game)
             if (!newopt)
                 throw std::runtime_error("Unknown world option '" + option_name + "'");
 
-            initialized_world_options.push_back(newopt);
+            world_options.push_back(newopt);
         }
         catch (const std::runtime_error &e)
         {
-            ++errors;
+            ++error_count;
             std::string error_str = std::string("World option error: ") + e.what();
-            OLogE(error_str);
-            OnScreenMessages::AddError(error_str);
+            log_error(error_str);
+            errors.push_back(error_str);
         }
     }
-    return errors;
+    return error_count;
 }
 
-std::vector<std::string>& WorldOptions_GetAllHooks(game_t *game, const std::string& hook_type, int line_breaks)
+std::vector<std::string> WorldOptions_GetAllHooks(game_t *game, const std::vector<WorldOption*>& world_options,
+    const std::string& hook_type, int line_breaks)
 {
-    static std::vector<std::string> content;
-
-    content.clear();
+    std::vector<std::string> content;
 
     // Warn on generation for missing / incomplete logic
     if (hook_type == "generate_early" &&
@@ -619,11 +615,10 @@ std::vector<std::string>& WorldOptions_GetAllHooks(game_t *game, const std::stri
     }
 
     // Mix in option hooks
-    for (WorldOption *opt : initialized_world_options)
+    for (WorldOption *opt : world_options)
     {
-        static std::vector<std::string> temp;
+        std::vector<std::string> temp;
 
-        temp.clear();
         opt->InsertWorldHook(game, hook_type, temp);
         if (temp.empty())
             continue;
@@ -638,15 +633,15 @@ std::vector<std::string>& WorldOptions_GetAllHooks(game_t *game, const std::stri
     return content;
 }
 
-void WorldOptions_MixinPyOptions(game_t *game, std::vector<PyOption>& pyopts)
+void WorldOptions_MixinPyOptions(game_t *game, const std::vector<WorldOption*>& world_options, std::vector<PyOption>& pyopts)
 {
-    for (WorldOption *opt : initialized_world_options)
+    for (WorldOption *opt : world_options)
         opt->InsertPyOptions(game, pyopts);
 }
 
-void WorldOptions_Deinit(void)
+void WorldOptions_Deinit(std::vector<WorldOption*>& world_options)
 {
-    for (WorldOption *opt : initialized_world_options)
+    for (WorldOption *opt : world_options)
         delete opt;
-    initialized_world_options.clear();
+    world_options.clear();
 }
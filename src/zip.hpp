@@ -5,7 +5,7 @@
 
 #include <sys/stat.h>
 #include <zlib/zlib.h>
-#include <onut/Json.h>
+#include <json/json.h>
 
 class GroupedOutput
 {
@@ -92,7 +92,13 @@ private:
 public:
 	void SetDateTime(time_t tt = time(NULL))
 	{
-		struct tm* datetime = localtime(&tt);
+		struct tm local_tt; // Several worlds may be generated at once, so not localtime()
+#if defined(_WIN32)
+		localtime_s(&local_tt, &tt);
+#else
+		localtime_r(&tt, &local_tt);
+#endif
+		struct tm* datetime = &local_tt;
 		moddate = 0;
 		moddate |= ((datetime->tm_year - 80) << 9);
 		moddate |= ((datetime->tm_mon + 1) << 5);
@@ -132,7 +138,7 @@ class ZipFile : public GroupedOutput
 
 	void WriteShort(uint16_t i)
 	{
-		static char buf[2];
+		char buf[2];
 		buf[0] = (uint8_t)(i);
 		buf[1] = (uint8_t)(i >> 8);
 		Write(buf, 2);
@@ -140,7 +146,7 @@ class ZipFile : public GroupedOutput
 
 	void WriteLong(uint32_t i)
 	{
-		static char buf[4];
+		char buf[4];
 		buf[0] = (uint8_t)(i);
 		buf[1] = (uint8_t)(i >> 8);
 		buf[2] = (uint8_t)(i >> 16);